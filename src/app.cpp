@@ -2,6 +2,16 @@
 
 #include "mc_MeshCodec.h"
 
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <sstream>
+
 using DirectoryIter = std::filesystem::recursive_directory_iterator;
 
 constexpr static auto cShaderStageNames = std::to_array<std::string_view>({
@@ -14,47 +24,139 @@ constexpr static auto cInterfaceTypeNames = std::to_array<std::string_view>({
     "Storage Buffers", "Images", "Separate Textures", "Separate Samplers",
 });
 
-static std::vector<unsigned char> sWorkMemory(0x10000000);
-
-bool AppContext::ReadFile(const std::string path, std::vector<u8>& data) {
-    std::ifstream file(path, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open())
-        return false;
-    
-    data.resize(file.tellg());
-    file.seekg(0);
-
-    file.read(reinterpret_cast<char*>(data.data()), data.size());
-
-    file.close();
-
-    return true;
+bool AppContext::ReadFile(const std::string path, MappedFile& data, MappedFile::Access access, MappedFile::Advice advice) {
+    return data.Open(path, access, advice);
 }
 
-void AppContext::WriteFile(const std::string path, const std::span<const u8>& data) {
+bool AppContext::WriteFile(const std::string path, const std::span<const u8>& data) {
     std::ofstream file(path, std::ios::binary);
     file.write(reinterpret_cast<const char*>(data.data()), data.size());
     file.close();
+    return !file.fail();
 }
 
 bool AppContext::DecompressFile(const std::string path, std::vector<u8>& data) {
-    std::vector<u8> fileData{};
-    if (!ReadFile(path, fileData)) {
+    MappedFile fileData{};
+    if (!ReadFile(path, fileData, MappedFile::Access::ReadOnly, MappedFile::Advice::Sequential)) {
         std::cout << "Failed to read file: " << path << "\n";
         return false;
     }
 
-    auto header = reinterpret_cast<const mc::ResMeshCodecPackageHeader*>(fileData.data());
+    if (!DecompressData(fileData.GetSpan(), data)) {
+        std::cout << "Failed to decompress file: " << path << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool AppContext::DecompressData(const std::span<const u8>& compressed, std::vector<u8>& data) {
+    // the decompressed size comes from the header, a truncated file would have it read past the end of the data
+    if (compressed.size() < sizeof(mc::ResMeshCodecPackageHeader))
+        return false;
+
+    auto header = reinterpret_cast<const mc::ResMeshCodecPackageHeader*>(compressed.data());
     const size_t decompressedSize = header->GetDecompressedSize();
     data.resize(decompressedSize);
 
-    if (!mc::DecompressMC(data.data(), data.size(), fileData.data(), fileData.size(), sWorkMemory.data(), sWorkMemory.size())) {
-        std::cout << "Failed to decompress file: " << path << "\n";
+    auto work_memory = mWorkMemoryPool.Acquire(WorkMemoryPool::GetRequiredSize(decompressedSize));
+    if (mc::DecompressMC(data.data(), data.size(), compressed.data(), compressed.size(), work_memory.Get().data(), work_memory.GetSize()))
+        return true;
+
+    // the estimate wasn't enough, retry with the old fixed size
+    if (work_memory.GetSize() >= WorkMemoryPool::cMaxBufferSize)
         return false;
+
+    work_memory.Grow(WorkMemoryPool::cMaxBufferSize);
+    return mc::DecompressMC(data.data(), data.size(), compressed.data(), compressed.size(), work_memory.Get().data(), work_memory.GetSize());
+}
+
+ResFile* AppContext::SetupFile(void* file_data) {
+    ResFile* file = reinterpret_cast<ResFile*>(file_data);
+
+    if (!file->IsRelocated()) {
+        RelocationStats stats{};
+        file->GetRelocationTable()->Relocate(&stats);
+
+        std::lock_guard lock(mStatsMutex);
+        mFileRelocationStats.entry_count += stats.entry_count;
+        mFileRelocationStats.pointer_count += stats.pointer_count;
+        mFileRelocationStats.thread_count = std::max(mFileRelocationStats.thread_count, stats.thread_count);
+        mFileRelocationStats.duration += stats.duration;
     }
 
-    return true;
+    if (!file->IsRelocatedExternalStrings())
+        file->RelocateExternalStrings(mExternalStringTable);
+    
+    if (!file->IsRelocatedExternalStrings())
+        return nullptr;
+
+    return file;
+}
+
+bool AppContext::InitializeShaderArchive(const std::string& path) {
+    const auto start = std::chrono::steady_clock::now();
+
+    // only the pages that are actually used get faulted in, most of the archive is shader code that is never read
+    if (!ReadFile(path, mShaderArchiveStorage, MappedFile::Access::CopyOnWrite, MappedFile::Advice::Random)) {
+        std::cout << "Failed to open " << path << "\n";
+        return false;
+    }
+
+    const auto map_time = std::chrono::steady_clock::now() - start;
+
+    RelocationStats stats{};
+    auto header = reinterpret_cast<BinaryFileHeader*>(mShaderArchiveStorage.GetData());
+    if (!header->IsRelocated())
+        header->GetRelocationTable()->Relocate(&stats, RelocationTable::cMaxThreadCount);
+
+    if (sReportTiming) {
+        std::cout << std::format("Mapped {} in {:.3f} ms\n", path, std::chrono::duration<double, std::milli>(map_time).count());
+        PrintRelocationStats(path, stats);
+    }
+
+    return mShaderArchive.Initialize(g3d2::ResShaderFile::ResCast(mShaderArchiveStorage.GetData()));
+}
+
+bool AppContext::InitializeSelectionIndex(const std::string& path, const std::string& archive_path) {
+    if (!ReadFile(path, mShaderArchiveStorage, MappedFile::Access::CopyOnWrite, MappedFile::Advice::Normal)) {
+        std::cout << "Failed to open " << path << "\n";
+        return false;
+    }
+
+    auto header = reinterpret_cast<selection_index::ResSelectionIndexFile*>(mShaderArchiveStorage.GetData());
+    if (mShaderArchiveStorage.GetSize() < sizeof(selection_index::ResSelectionIndexFile) || !header->IsValid()) {
+        std::cout << path << " is not a selection index (or was built by a different version)\n";
+        return false;
+    }
+
+    if (std::filesystem::exists(archive_path)) {
+        MappedFile archive{};
+        if (!ReadFile(archive_path, archive, MappedFile::Access::ReadOnly, MappedFile::Advice::Sequential)) {
+            std::cout << "Failed to open " << archive_path << "\n";
+            return false;
+        }
+
+        if (archive.GetSize() != header->source_size || selection_index::ComputeFingerprint(archive.GetSpan()) != header->source_fingerprint) {
+            std::cout << std::format("{} was not built from {}, rebuild it with mat-tool index build\n", path, archive_path);
+            return false;
+        }
+    }
+
+    RelocationStats stats{};
+    if (!header->IsRelocated())
+        header->GetRelocationTable()->Relocate(&stats, RelocationTable::cMaxThreadCount);
+
+    if (sReportTiming)
+        PrintRelocationStats(path, stats);
+
+    return mShaderArchive.Initialize(g3d2::ResShaderFile::ResCast(mShaderArchiveStorage.GetData()));
+}
+
+void AppContext::PrintRelocationStats(const std::string_view name, const RelocationStats& stats) {
+    std::cout << std::format("Relocated {}: {} entries, {} pointers in {:.3f} ms using {} thread(s)\n",
+                             name, stats.entry_count, stats.pointer_count,
+                             std::chrono::duration<double, std::milli>(stats.duration).count(), stats.thread_count);
 }
 
 bool MaterialParser::Initialize() {
@@ -66,7 +168,12 @@ bool MaterialParser::Initialize() {
         return false;
     }
 
-    if (!mContext.InitializeShaderArchive(mMaterialArchivePath)) {
+    if (mSelectionIndexPath != "") {
+        if (!mContext.InitializeSelectionIndex(mSelectionIndexPath, mMaterialArchivePath)) {
+            std::cout << "Failed to load selection index\n";
+            return false;
+        }
+    } else if (!mContext.InitializeShaderArchive(mMaterialArchivePath)) {
         std::cout << "Failed to load shader archive\n";
         return false;
     }
@@ -75,34 +182,46 @@ bool MaterialParser::Initialize() {
     return true;
 }
 
-void MaterialParser::ProcessFile(const std::string path, json& output, bool compressed) {
-    std::vector<u8> fileBuffer{};
-    
-    if (compressed) {
-        if (!mContext.DecompressFile(path, fileBuffer))
-            throw std::runtime_error(std::format("Failed to read file: {}", path));
-    } else {
-        if (!mContext.ReadFile(path, fileBuffer))
-            throw std::runtime_error(std::format("Failed to read file: {}", path));
-    }
-    
-    ResFile* file = mContext.SetupFile(fileBuffer.data());
+MappedFile MaterialParser::ReadStage(const FileEntry& entry) const {
+    // compressed files are only read by the decompressor, uncompressed ones get relocated in place
+    // WillNeed starts paging the file in asynchronously so the disk reads overlap with the later stages
+    MappedFile data{};
+    const auto access = entry.compressed ? MappedFile::Access::ReadOnly : MappedFile::Access::CopyOnWrite;
+    if (!mContext.ReadFile(entry.path, data, access, MappedFile::Advice::WillNeed) || data.IsEmpty())
+        throw std::runtime_error(std::format("Failed to read file: {}", entry.path));
 
-    if (file == nullptr)
-        throw std::runtime_error(std::format("Failed to setup file: {}", path));
+    return data;
+}
+
+void MaterialParser::DecompressStage(const FileEntry& entry, FileData& data) {
+    if (!entry.compressed)
+        return;
 
-    const g3d2::ResShaderFile* shader_file = mContext.GetShaderArchive();
+    if (!mContext.DecompressData(data.source.GetSpan(), data.decompressed))
+        throw std::runtime_error(std::format("Failed to decompress file: {}", entry.path));
 
-    const std::string filename = Path(path).filename().string();
+    data.source.Close();
+}
+
+json MaterialParser::ParseStage(const FileEntry& entry, FileData& data) {
+    ResFile* file = mContext.SetupFile(data.GetData());
+
+    if (file == nullptr)
+        throw std::runtime_error(std::format("Failed to setup file: {}", entry.path));
 
-    std::cout << filename << "\n";
+    const ShaderArchive& archive = mContext.GetShaderArchive();
 
-    output[filename] = json({});
+    {
+        std::lock_guard lock(mLogMutex);
+        std::cout << entry.filename << "\n";
+    }
+
+    json output = json({});
     
     for (size_t i = 0; i < file->model_count; ++i) {
         const auto& model = file->models[i];
         const std::string_view model_name = model.name->Get();
-        output[filename][model_name] = json({});
+        output[model_name] = json({});
 
         for (size_t j = 0; j < model.material_count; ++j) {
             const auto& mat = model.material_array[j];
@@ -125,15 +244,9 @@ void MaterialParser::ProcessFile(const std::string path, json& output, bool comp
             for (size_t k = 0; k < mat.texture_count; ++k)
                 mat_info["Textures"].push_back(mat.texture_name_array[k]->Get());
 
-            for (u8 k = 0; k < 0x10; ++k) {
-                selector.SetOption(ShaderSelector::cWeightName, ShaderSelector::cNumberNames[k]);
-
-                const auto program = selector.Search(shader_file);
-
-                if (program != nullptr) {
-                    mat_info["Skin Counts"].push_back(k);
-                    mat_info["Shader Indices"].push_back(std::distance(static_cast<const g3d2::ResShaderProgram*>(program->parent_model->program_array), program));
-                }
+            for (const auto& [skin_count, program_index] : mSelectionCache.SearchVariants(selector, archive)) {
+                mat_info["Skin Counts"].push_back(skin_count);
+                mat_info["Shader Indices"].push_back(program_index);
             }
 
             for (size_t k = 0; k < mat.shader_data->total_static_option_count; ++k) {
@@ -164,35 +277,117 @@ void MaterialParser::ProcessFile(const std::string path, json& output, bool comp
                 }
             }
 
-            output[filename][model_name][mat_name] = std::move(mat_info);
+            output[model_name][mat_name] = std::move(mat_info);
         }
     }
+
+    return output;
+}
+
+std::vector<MaterialParser::FileEntry> MaterialParser::CollectFiles() const {
+    const Path model_path = mRomfsPath / Path("Model");
+
+    // the output is keyed by filename, so only the last file visited with a given name would survive anyways
+    std::map<std::string, FileEntry> entries{};
+    for (const auto& entry : DirectoryIter(model_path)) {
+        const bool compressed = entry.path().extension() == ".mc";
+        if (!compressed && entry.path().extension() != ".bfres")
+            continue;
+
+        std::string filename = entry.path().filename().string();
+        entries.insert_or_assign(filename, FileEntry{ entry.path().string(), filename, static_cast<size_t>(entry.file_size()), compressed });
+    }
+
+    std::vector<FileEntry> files{};
+    files.reserve(entries.size());
+    for (auto& [filename, entry] : entries)
+        files.emplace_back(std::move(entry));
+
+    return files;
+}
+
+void MaterialParser::RunSerial(const std::vector<FileEntry>& files, const ResultWriter& write) {
+    for (const auto& entry : files) {
+        FileData data{ ReadStage(entry), {} };
+        DecompressStage(entry, data);
+        write(entry, ParseStage(entry, data));
+    }
+}
+
+void MaterialParser::RunPipeline(const std::vector<FileEntry>& files, const ResultWriter& write) {
+    const OrderedPipeline<FileData, json> pipeline(
+        [&](size_t index) { return FileData{ ReadStage(files[index]), {} }; },
+        [&](size_t index, FileData& data) { DecompressStage(files[index], data); },
+        [&](size_t index, FileData& data) { return ParseStage(files[index], data); },
+        [&](size_t index, json& info) { write(files[index], info); });
+
+    // the largest files are read first within the pipeline's window so a single big file doesn't end up being the tail of the run
+    pipeline.Run(files.size(), mJobCount, [&](size_t index) { return files[index].size; });
 }
 
 void MaterialParser::Run() {
     if (!Initialize())
         return;
 
-    const Path model_path = mRomfsPath / Path("Model");
-    json output{};
+    const std::vector<FileEntry> files = CollectFiles();
 
-    for (const auto& entry : DirectoryIter(model_path)) {
-        if (entry.path().extension() == ".mc") {
-            ProcessFile(entry.path().string(), output);
-        } else if (entry.path().extension() == ".bfres") {
-            ProcessFile(entry.path().string(), output, false);
+    const auto run = [&](const ResultWriter& write) {
+        if (mJobCount <= 1) {
+            RunSerial(files, write);
+        } else {
+            RunPipeline(files, write);
         }
+    };
+
+    // output goes to a temporary file that only replaces the previous output once it's complete, so a failed or interrupted dump
+    // doesn't leave a truncated file behind
+    const std::string temp_path = mOutputPath + ".tmp";
+    if (mFormat == OutputFormat::MatDb) {
+        // the database is laid out only once everything has been added, the json of each file is dropped as soon as it's been added
+        MaterialDbBuilder builder{};
+        run([&](const FileEntry& entry, const json& info) { builder.AddFile(entry.filename, info); });
+
+        const std::vector<u8> database = builder.Build();
+        if (!mContext.WriteFile(temp_path, database))
+            throw std::runtime_error(std::format("Failed to write {}", temp_path));
+        std::filesystem::rename(temp_path, mOutputPath);
+        std::cout << std::format("Wrote {} ({} material(s), {:#x} bytes)\n", mOutputPath, builder.GetMaterialCount(), database.size());
+    } else {
+        // each file's result is written as soon as it's ready instead of building the whole romfs into one tree first
+        std::ofstream out(temp_path, IsBinaryFormat(mFormat) ? std::ios::out | std::ios::binary : std::ios::out);
+        JsonObjectWriter writer(out, mLayout, mFormat, files.size());
+        run([&](const FileEntry& entry, const json& info) { writer.Write(entry.filename, info); });
+        writer.Finish();
+
+        out.close();
+        if (!out)
+            throw std::runtime_error(std::format("Failed to write {}", temp_path));
+        std::filesystem::rename(temp_path, mOutputPath);
     }
 
-    std::ofstream out(mOutputPath);
-    out << std::setw(2) << output << std::endl;
+    const auto& work_memory = mContext.GetWorkMemoryPool();
+    std::cout << std::format("MeshCodec work memory high-water mark: {:#x} bytes across {} buffer(s)\n", work_memory.GetHighWaterMark(), work_memory.GetBufferCount());
+
+    const u64 lookups = mSelectionCache.GetHitCount() + mSelectionCache.GetMissCount();
+    std::cout << std::format("Program selection cache: {} hit(s), {} miss(es) ({:.1f}% hit rate), {} distinct option set(s)\n",
+                             mSelectionCache.GetHitCount(), mSelectionCache.GetMissCount(),
+                             lookups > 0 ? 100.0 * mSelectionCache.GetHitCount() / lookups : 0.0, mSelectionCache.GetEntryCount());
+
+    if (AppContext::sReportTiming) {
+        AppContext::PrintRelocationStats(std::format("{} model files", files.size()), mContext.GetFileRelocationStats());
+    }
 }
 
 bool MaterialSearcher::Initialize() {
     if (mInitialized)
         return mInitialized;
 
-   if (!mContext.InitializeShaderArchive(mMaterialArchivePath)) {
+    if (mSelectionIndexPath != "") {
+        if (!mContext.InitializeSelectionIndex(mSelectionIndexPath, mMaterialArchivePath)) {
+            std::cout << "Failed to load selection index\n";
+            return false;
+        }
+    } else if (!mContext.InitializeShaderArchive(mMaterialArchivePath)) {
         std::cout << "Failed to load shader archive\n";
         return false;
     }
@@ -236,114 +431,776 @@ static const std::string_view TryConvertRenderInfo(const std::string_view key, c
     return value;
 }
 
-void MaterialSearcher::Print(const g3d2::ResShadingModel* model, const u32* keys, size_t index) const {
-    *mOutStream << std::format("Shader Program {}:\n", index);
-    if (mVerbose) {
-        if (model->static_option_count > 0) {
-            *mOutStream << "  Static:\n";
-            for (size_t i = 0; i < model->static_option_count; ++i) {
-                const auto& opt = model->static_option_array[i];
-                const u32 value = GetStaticKeyValue(keys, &opt);
-                if (value == opt.default_choice) {
-                    continue;
-                }
-                const std::string_view key = opt.name->Get();
-                const std::string_view val = opt.choice_dict->entries[value + 1].key->Get();
-                *mOutStream << std::format("    {}: {}\n", key, TryConvertRenderInfo(key, val));
+void MaterialSearcher::CollectOptions(const Query& query, const u32* keys, bool verbose, OptionList& static_options, OptionList& dynamic_options) {
+    const g3d2::ResShadingModel* model = query.model;
+    if (verbose) {
+        for (size_t i = 0; i < model->static_option_count; ++i) {
+            const auto& opt = model->static_option_array[i];
+            const u32 value = GetStaticKeyValue(keys, &opt);
+            if (value == opt.default_choice) {
+                continue;
             }
+            const std::string_view key = opt.name->Get();
+            const std::string_view val = opt.choice_dict->entries[value + 1].key->Get();
+            static_options.emplace_back(key, TryConvertRenderInfo(key, val));
         }
-        if (model->dynamic_option_count > 0) {
-            *mOutStream << "  Dynamic:\n";
-            for (size_t i = 0; i < model->dynamic_option_count; ++i) {
-                const auto& opt = model->dynamic_option_array[i];
-                const u32 value = GetDynamicKeyValue(keys, &opt, model->static_key_count);
-                if (value == opt.default_choice) {
-                    continue;
-                }
-                *mOutStream << std::format("    {}: {}\n", opt.name->Get(), opt.choice_dict->entries[value + 1].key->Get());
+        for (size_t i = 0; i < model->dynamic_option_count; ++i) {
+            const auto& opt = model->dynamic_option_array[i];
+            const u32 value = GetDynamicKeyValue(keys, &opt, model->static_key_count);
+            if (value == opt.default_choice) {
+                continue;
             }
+            dynamic_options.emplace_back(opt.name->Get(), opt.choice_dict->entries[value + 1].key->Get());
         }
     } else {
-        if (!mStaticConstraints.empty()) {
-            *mOutStream << "  Static:\n";
-            for (const auto& constraint : mStaticConstraints) {
-                const u32 value = GetStaticKeyValue(keys, constraint.option);
-                const std::string_view key = constraint.option->name->Get();
-                const std::string_view val = constraint.option->choice_dict->entries[value + 1].key->Get();
-                *mOutStream << std::format("    {}: {}\n", key, TryConvertRenderInfo(key, val));
-            }
+        for (const auto& constraint : query.static_constraints) {
+            const u32 value = GetStaticKeyValue(keys, constraint.option);
+            const std::string_view key = constraint.option->name->Get();
+            const std::string_view val = constraint.option->choice_dict->entries[value + 1].key->Get();
+            static_options.emplace_back(key, TryConvertRenderInfo(key, val));
         }
-        if (!mDynamicConstraints.empty()) {
-            *mOutStream << "  Dynamic:\n";
-            for (const auto& constraint : mDynamicConstraints) {
-                const u32 value = GetDynamicKeyValue(keys, constraint.option, model->static_key_count);
-                *mOutStream << std::format("    {}: {}\n", constraint.option->name->Get(), constraint.option->choice_dict->entries[value + 1].key->Get());
-            }
+        for (const auto& constraint : query.dynamic_constraints) {
+            const u32 value = GetDynamicKeyValue(keys, constraint.option, model->static_key_count);
+            dynamic_options.emplace_back(constraint.option->name->Get(), constraint.option->choice_dict->entries[value + 1].key->Get());
+        }
+    }
+}
+
+void MaterialSearcher::Print(const Query& query, const u32* keys, size_t index) const {
+    OptionList static_options{};
+    OptionList dynamic_options{};
+    CollectOptions(query, keys, mVerbose, static_options, dynamic_options);
+
+    *mOutStream << std::format("Shader Program {}:\n", index);
+    if (mVerbose ? query.model->static_option_count > 0 : !query.static_constraints.empty()) {
+        *mOutStream << "  Static:\n";
+        for (const auto& [key, val] : static_options) {
+            *mOutStream << std::format("    {}: {}\n", key, val);
+        }
+    }
+    if (mVerbose ? query.model->dynamic_option_count > 0 : !query.dynamic_constraints.empty()) {
+        *mOutStream << "  Dynamic:\n";
+        for (const auto& [key, val] : dynamic_options) {
+            *mOutStream << std::format("    {}: {}\n", key, val);
+        }
+    }
+}
+
+MaterialSearcher::Query MaterialSearcher::ParseQuery(const ShaderArchive& archive, const json& config) {
+    Query query{};
+
+    const std::string model_name = config.value("Model Name", "material");
+    query.model = archive.FindModel(model_name);
+    if (query.model == nullptr) {
+        throw std::runtime_error(std::format("No model named {}", model_name));
+    }
+
+    const auto& static_opts = config.value("Static Options", json({}));
+    for (const auto& [key, val] : static_opts.items()) {
+        query.static_constraints.emplace_back(key, val, query.model);
+    }
+    const auto& render_info = config.value("Render Info", json({}));
+    for (const auto& [key, val] : render_info.items()) {
+        if (IsStaticOptionRenderInfo(key)) {
+            query.static_constraints.emplace_back(key, val, query.model);
         }
     }
+    const auto& dynamic_opts = config.value("Dynamic Options", json({}));
+    for (const auto& [key, val] : dynamic_opts.items()) {
+        query.dynamic_constraints.emplace_back(key, val, query.model);
+    }
+
+    return query;
+}
+
+std::vector<u64> MaterialSearcher::Execute(const ShaderArchive& archive, const Query& query, std::ostream* explain_stream) {
+    std::vector<SearchPlan::Term> terms{};
+    for (const auto& constraint : query.static_constraints) {
+        terms.push_back(constraint.ToTerm());
+    }
+    for (const auto& constraint : query.dynamic_constraints) {
+        terms.push_back(constraint.ToTerm());
+    }
+
+    const SearchPlan plan(archive, query.model, terms);
+    if (explain_stream != nullptr) {
+        plan.Explain(*explain_stream);
+    }
+
+    std::vector<u64> matches{};
+    plan.Execute(matches);
+    return matches;
+}
+
+template <typename Func>
+static void ForEachMatch(const std::vector<u64>& matches, Func&& func) {
+    for (size_t block = 0; block < matches.size(); ++block) {
+        for (u64 bits = matches[block]; bits != 0; bits &= bits - 1) {
+            func(block * 64 + std::countr_zero(bits));
+        }
+    }
+}
+
+bool MaterialSearcher::IsBatch() const {
+    return std::filesystem::is_directory(mConfigPath) || Path(mConfigPath).extension() == ".jsonl";
 }
 
 void MaterialSearcher::Run() {
     if (!Initialize())
         return;
 
+    if (IsBatch()) {
+        RunBatch();
+        return;
+    }
+
     std::ifstream f(mConfigPath);
     json data = json::parse(f);
     const std::string model_name = data.value("Model Name", "material");
     
-    const g3d2::ResShaderFile* shader_file = mContext.GetShaderArchive();
+    const ShaderArchive& archive = mContext.GetShaderArchive();
 
-    g3d2::ResShadingModel* model = nullptr;
-    for (size_t i = 0; i < shader_file->archive->shading_model_count; ++i) {
-        if (shader_file->archive->shading_model_array[i].name->Get() == model_name) {
-            model = shader_file->archive->shading_model_array + i;
-            break;
+    if (archive.FindModel(model_name) == nullptr) {
+        std::cout << std::format("No model named {}\n", model_name);
+        std::cout << "Available models:\n";
+        for (size_t i = 0; i < archive.GetModelCount(); ++i) {
+            std::cout << "  " << archive.GetModel(i)->name->Get() << "\n";
         }
+        return;
+    }
+
+    if (mFormat != OutputFormat::Text) {
+        // same object a batch writes for each query
+        ordered_json result = ordered_json::object();
+        Answer(result, archive, data, mVerbose, mExplain);
+        WriteDocument(*mOutStream, result, mFormat);
+        return;
+    }
+
+    const Query query = ParseQuery(archive, data);
+    const u32 row_width = query.model->static_key_count + query.model->dynamic_key_count;
+
+    ForEachMatch(Execute(archive, query, mExplain ? mOutStream : nullptr), [&](size_t i) {
+        Print(query, query.model->key_table + row_width * i, i);
+    });
+}
+
+std::vector<MaterialSearcher::BatchEntry> MaterialSearcher::LoadBatch() const {
+    std::vector<BatchEntry> entries{};
+
+    if (std::filesystem::is_directory(mConfigPath)) {
+        std::vector<Path> paths{};
+        for (const auto& entry : std::filesystem::directory_iterator(mConfigPath)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".json") {
+                paths.push_back(entry.path());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+
+        for (const auto& path : paths) {
+            BatchEntry& entry = entries.emplace_back();
+            entry.id = path.stem().string();
+            std::ifstream f(path);
+            entry.config = json::parse(f, nullptr, false);
+            if (entry.config.is_discarded()) {
+                entry.error = std::format("Failed to parse {}", path.string());
+            }
+        }
+        return entries;
+    }
+
+    std::ifstream f(mConfigPath);
+    if (!f) {
+        throw std::runtime_error(std::format("Failed to open {}", mConfigPath));
+    }
+
+    std::string line;
+    for (size_t line_number = 1; std::getline(f, line); ++line_number) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        BatchEntry& entry = entries.emplace_back();
+        entry.config = json::parse(line, nullptr, false);
+        if (entry.config.is_discarded() || !entry.config.is_object()) {
+            entry.id = std::to_string(line_number);
+            entry.error = std::format("Failed to parse line {}", line_number);
+        } else if (entry.config.contains("Id")) {
+            entry.id = entry.config["Id"].is_string() ? entry.config["Id"].get<std::string>() : entry.config["Id"].dump();
+        } else {
+            entry.id = std::to_string(line_number);
+        }
+    }
+    return entries;
+}
+
+void MaterialSearcher::Answer(ordered_json& result, const ShaderArchive& archive, const json& config, bool verbose, bool explain) {
+    const Query query = ParseQuery(archive, config);
+    const u32 row_width = query.model->static_key_count + query.model->dynamic_key_count;
+
+    std::ostringstream plan{};
+    const std::vector<u64> matches = Execute(archive, query, explain ? &plan : nullptr);
+
+    ordered_json programs = ordered_json::array();
+    ForEachMatch(matches, [&](size_t i) {
+        OptionList static_options{};
+        OptionList dynamic_options{};
+        CollectOptions(query, query.model->key_table + row_width * i, verbose, static_options, dynamic_options);
+
+        ordered_json program = {
+            {"Index", i},
+            {"Static Options", ordered_json::object()},
+            {"Dynamic Options", ordered_json::object()},
+        };
+        for (const auto& [key, val] : static_options) {
+            program["Static Options"][key] = val;
+        }
+        for (const auto& [key, val] : dynamic_options) {
+            program["Dynamic Options"][key] = val;
+        }
+        programs.push_back(std::move(program));
+    });
+
+    result["Model Name"] = query.model->name->Get();
+    result["Match Count"] = programs.size();
+    if (explain) {
+        result["Plan"] = plan.str();
+    }
+    result["Programs"] = std::move(programs);
+}
+
+std::string MaterialSearcher::RunBatchEntry(const BatchEntry& entry) const {
+    ordered_json result = {
+        {"Id", entry.id},
+    };
+
+    if (!entry.error.empty()) {
+        result["Error"] = entry.error;
+        return EncodeRecord(result, mFormat);
+    }
+
+    try {
+        Answer(result, mContext.GetShaderArchive(), entry.config, mVerbose, mExplain);
+    } catch (const std::exception& e) {
+        result["Error"] = e.what();
+    }
+
+    return EncodeRecord(result, mFormat);
+}
+
+void MaterialSearcher::RunBatch() {
+    const std::vector<BatchEntry> entries = LoadBatch();
+
+    if (mJobCount <= 1) {
+        for (const auto& entry : entries) {
+            *mOutStream << RunBatchEntry(entry);
+        }
+        mOutStream->flush();
+        return;
+    }
+
+    // results are written in input order as soon as every earlier query is done
+    std::vector<std::optional<std::string>> results(entries.size());
+    size_t next_result = 0;
+    std::mutex output_mutex;
+
+    ThreadPool pool(mJobCount);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        pool.Submit([&, i](u32) {
+            std::string record = RunBatchEntry(entries[i]);
+
+            std::lock_guard lock(output_mutex);
+            results[i] = std::move(record);
+            for (; next_result < results.size() && results[next_result].has_value(); ++next_result) {
+                *mOutStream << *results[next_result];
+                results[next_result].reset();
+            }
+        });
+    }
+    pool.Wait();
+    mOutStream->flush();
+}
+
+bool MaterialServer::Initialize() {
+    if (mInitialized)
+        return mInitialized;
+
+    if (mSelectionIndexPath != "") {
+        if (!mContext.InitializeSelectionIndex(mSelectionIndexPath, mMaterialArchivePath)) {
+            std::cerr << "Failed to load selection index\n";
+            return false;
+        }
+    } else if (!mContext.InitializeShaderArchive(mMaterialArchivePath)) {
+        std::cerr << "Failed to load shader archive\n";
+        return false;
+    }
+
+    mInitialized = true;
+    return true;
+}
+
+void MaterialServer::Select(ordered_json& result, const json& request) const {
+    const ShaderArchive& archive = mContext.GetShaderArchive();
+
+    ShaderSelector selector{};
+    selector.LoadOptions(request, archive);
+
+    const std::string model_name = request.value("Model Name", "material");
+    if (archive.FindModel(model_name) == nullptr) {
+        throw std::runtime_error(std::format("No model named {}", model_name));
     }
 
+    // the same lookups dump does for each material
+    result["Model Name"] = model_name;
+    result["Program Index"] = selector.Search(archive);
+    result["Skin Counts"] = ordered_json::array();
+    result["Shader Indices"] = ordered_json::array();
+    for (const auto& [skin_count, program_index] : selector.SearchVariants(archive, ShaderSelector::cWeightName, std::span(ShaderSelector::cNumberNames).first(0x10))) {
+        result["Skin Counts"].push_back(skin_count);
+        result["Shader Indices"].push_back(program_index);
+    }
+}
+
+void MaterialServer::Info(ordered_json& result, const json& request) const {
+    const ShaderArchive& archive = mContext.GetShaderArchive();
+
+    const std::string model_name = request.value("Model Name", "material");
+    const g3d2::ResShadingModel* model = archive.FindModel(model_name);
     if (model == nullptr) {
-        std::cout << std::format("No model named {}\n", model_name);
-        std::cout << "Available models:\n";
-        for (size_t i = 0; i < shader_file->archive->shading_model_count; ++i) {
-            std::cout << "  " << shader_file->archive->shading_model_array[i].name->Get() << "\n";
+        throw std::runtime_error(std::format("No model named {}", model_name));
+    }
+
+    result["Model Name"] = model->name->Get();
+    result["Program Count"] = model->shader_program_count;
+
+    const int program_index = request.value("Program Index", -1);
+    if (program_index < 0) {
+        ShaderInfoPrinter::ProcessOptions(result, model);
+        return;
+    }
+    if (program_index >= model->shader_program_count) {
+        throw std::runtime_error(std::format("Out of range program index for model {}: {}", model->name->Get(), program_index));
+    }
+
+    // the choice of every option the program was compiled with
+    const u32* keys = model->key_table + (model->static_key_count + model->dynamic_key_count) * program_index;
+    result["Program Index"] = program_index;
+    result["Static Options"] = ordered_json::object();
+    for (size_t i = 0; i < model->static_option_count; ++i) {
+        const auto& opt = model->static_option_array[i];
+        const std::string_view key = opt.name->Get();
+        result["Static Options"][key] = TryConvertRenderInfo(key, opt.choice_dict->entries[GetStaticKeyValue(keys, &opt) + 1].key->Get());
+    }
+    result["Dynamic Options"] = ordered_json::object();
+    for (size_t i = 0; i < model->dynamic_option_count; ++i) {
+        const auto& opt = model->dynamic_option_array[i];
+        result["Dynamic Options"][opt.name->Get()] = opt.choice_dict->entries[GetDynamicKeyValue(keys, &opt, model->static_key_count) + 1].key->Get();
+    }
+}
+
+void MaterialServer::Stop() {
+    mStopping = true;
+    mListener.Shutdown();
+    mInput.Shutdown();
+}
+
+std::string MaterialServer::HandleRequest(const std::string& line) {
+    const auto start = std::chrono::steady_clock::now();
+
+    ordered_json result = ordered_json::object();
+    const json request = json::parse(line, nullptr, false);
+    if (request.is_discarded() || !request.is_object()) {
+        result["Error"] = "Failed to parse request";
+    } else {
+        if (request.contains("Id")) {
+            result["Id"] = request["Id"];
+        }
+        try {
+            const std::string action = request.value("Action", "");
+            if (action == "select") {
+                Select(result, request);
+            } else if (action == "search") {
+                MaterialSearcher::Answer(result, mContext.GetShaderArchive(), request, request.value("Verbose", false), request.value("Explain", false));
+            } else if (action == "info") {
+                Info(result, request);
+            } else if (action == "shutdown") {
+                Stop();
+            } else {
+                throw std::runtime_error(std::format("Unknown action: {}", action));
+            }
+        } catch (const std::exception& e) {
+            result["Error"] = e.what();
+        }
+    }
+
+    const auto latency = std::chrono::steady_clock::now() - start;
+    result["Latency (ms)"] = std::chrono::duration<double, std::milli>(latency).count();
+    ++mRequestCount;
+    mTotalLatency += static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+
+    return result.dump();
+}
+
+void MaterialServer::ServeStream() {
+    // reading through a LocalSocket lets a shutdown request that's answered on a worker wake up the blocked read, without sockets
+    // (windows) the server only notices the shutdown once the next line arrives
+    mInput = LocalSocket::OpenStandardInput();
+    const auto read_line = [this](std::string& line) {
+        return mInput.IsValid() ? mInput.ReadLine(line) : static_cast<bool>(std::getline(std::cin, line));
+    };
+
+    std::string line;
+
+    if (mJobCount <= 1) {
+        while (!mStopping && read_line(line)) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+            std::cout << HandleRequest(line) << std::endl;
         }
         return;
     }
 
-    const auto& static_opts = data.value("Static Options", json({}));
-    for (const auto& [key, val] : static_opts.items()) {
-        mStaticConstraints.emplace_back(key, val, model);
+    // responses go out in completion order, clients match them up by id
+    std::mutex output_mutex;
+    ThreadPool pool(mJobCount);
+    while (!mStopping && read_line(line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        pool.Submit([&, request = std::move(line)](u32) {
+            const std::string response = HandleRequest(request);
+
+            std::lock_guard lock(output_mutex);
+            std::cout << response << std::endl;
+        });
     }
-    const auto& render_info = data.value("Render Info", json({}));
-    for (const auto& [key, val] : render_info.items()) {
-        if (IsStaticOptionRenderInfo(key)) {
-            mStaticConstraints.emplace_back(key, val, model);
+    pool.Wait();
+}
+
+void MaterialServer::ServeClient(Client& client) {
+    std::string line;
+    while (!mStopping && client.socket.ReadLine(line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        if (!client.socket.Write(HandleRequest(line) + "\n")) {
+            break;
         }
     }
-    const auto& dynamic_opts = data.value("Dynamic Options", json({}));
-    for (const auto& [key, val] : dynamic_opts.items()) {
-        mDynamicConstraints.emplace_back(key, val, model);
+    client.done = true;
+}
+
+void MaterialServer::ServeSocket() {
+    if (!LocalSocket::IsSupported()) {
+        throw std::runtime_error("Unix domain sockets are not supported on this platform, leave out --socket to serve over stdin/stdout");
+    }
+    if (!mListener.Listen(mSocketPath)) {
+        throw std::runtime_error(std::format("Failed to listen on {}: {}", mSocketPath, std::strerror(errno)));
     }
+    std::cerr << std::format("Listening on {}\n", mSocketPath);
 
-    for (size_t i = 0; i < model->shader_program_count; ++i) {
-        const int opt_index = (model->static_key_count + model->dynamic_key_count) * static_cast<int>(i);
-        const u32* keys = model->key_table + opt_index;
-        bool matched = true;
-        for (const auto& constraint : mStaticConstraints) {
-            if (!matched) {
-                break;
+    while (!mStopping) {
+        LocalSocket socket = mListener.Accept();
+        if (!socket.IsValid()) {
+            break;
+        }
+
+        std::lock_guard lock(mClientMutex);
+        // clients are only closed here (and on shutdown) so Stop never shuts down a socket that has already been closed
+        for (auto it = mClients.begin(); it != mClients.end();) {
+            if (it->done) {
+                it->thread.join();
+                it = mClients.erase(it);
+            } else {
+                ++it;
             }
-            matched = matched && constraint.Match(model, keys);
         }
-        for (const auto& constraint : mDynamicConstraints) {
-            if (!matched) {
+
+        Client& client = mClients.emplace_back();
+        client.socket = std::move(socket);
+        client.thread = std::thread(&MaterialServer::ServeClient, this, std::ref(client));
+    }
+
+    {
+        std::lock_guard lock(mClientMutex);
+        for (auto& client : mClients) {
+            client.socket.Shutdown();
+        }
+    }
+    for (auto& client : mClients) {
+        client.thread.join();
+    }
+    mClients.clear();
+    mListener.Close();
+}
+
+void MaterialServer::Run() {
+    if (!Initialize())
+        return;
+
+    if (mSocketPath == "") {
+        ServeStream();
+    } else {
+        ServeSocket();
+    }
+
+    const u64 count = mRequestCount;
+    if (count > 0) {
+        std::cerr << std::format("Answered {} request(s), average latency {:.3f} ms\n", count, static_cast<double>(mTotalLatency) / count / 1e6);
+    }
+}
+
+bool ScanBenchmark::Initialize() {
+    if (mInitialized)
+        return mInitialized;
+
+    if (!mContext.InitializeShaderArchive(mArchivePath)) {
+        std::cout << "Failed to load shader archive\n";
+        return false;
+    }
+
+    mInitialized = true;
+    return true;
+}
+
+template <typename Func>
+static double MeasureRowsPerSecond(u32 iterations, u64 rows_per_iteration, Func&& func) {
+    const auto start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < iterations; ++i) {
+        func();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds > 0.0 ? static_cast<double>(rows_per_iteration) * iterations / seconds : 0.0;
+}
+
+void ScanBenchmark::Run() {
+    if (!Initialize())
+        return;
+
+    const g3d2::ResShadingModel* model = mContext.GetShaderArchive().FindModel(mModelName);
+    if (model == nullptr) {
+        std::cout << std::format("No model named {}\n", mModelName);
+        return;
+    }
+
+    const u32 row_count = model->shader_program_count;
+    const u32 row_width = model->static_key_count + model->dynamic_key_count;
+    if (row_count == 0) {
+        std::cout << std::format("{} has no programs\n", mModelName);
+        return;
+    }
+
+    // the last row is the worst case for an exact match, every row before it has to be rejected
+    const u32* key = model->key_table + static_cast<size_t>(row_width) * (row_count - 1);
+
+    // filter on the default choice of the first few static options, which typically keeps a good part of the table alive
+    std::vector<Constraint<false>> constraints{};
+    for (size_t i = 0; i < std::min<size_t>(model->static_option_count, 4); ++i) {
+        const auto& option = model->static_option_array[i];
+        const std::string_view choice = option.choice_dict->entries[option.default_choice + 1].key->Get();
+        constraints.emplace_back(option.name->Get(), json(choice), model);
+    }
+    std::vector<key_scan::Clause> clauses{};
+    for (const auto& constraint : constraints) {
+        clauses.push_back(constraint.ToClause(model));
+    }
+    const key_scan::Program program = key_scan::Compile(clauses);
+
+    std::cout << std::format("{}: {} programs, {} key words per program, {} iteration(s)\n", mModelName, row_count, row_width, mIterations);
+
+    volatile s32 exact_sink = 0;
+    volatile size_t filter_sink = 0;
+
+    const double exact_reference = MeasureRowsPerSecond(mIterations, row_count, [&] {
+        s32 result = -1;
+        for (u32 i = 0; i < row_count; ++i) {
+            if (std::memcmp(model->key_table + static_cast<size_t>(row_width) * i, key, row_width * sizeof(u32)) == 0) {
+                result = static_cast<s32>(i);
                 break;
             }
-            matched = matched && constraint.Match(model, keys);
         }
-        if (matched) {
-            Print(model, keys, i);
+        exact_sink = result;
+    });
+    const double filter_reference = MeasureRowsPerSecond(mIterations, row_count, [&] {
+        size_t count = 0;
+        for (u32 i = 0; i < row_count; ++i) {
+            const u32* keys = model->key_table + static_cast<size_t>(row_width) * i;
+            bool matched = true;
+            for (const auto& constraint : constraints) {
+                if (!matched) {
+                    break;
+                }
+                matched = matched && constraint.Match(model, keys);
+            }
+            count += matched;
+        }
+        filter_sink = count;
+    });
+
+    std::cout << std::format("  {:<10} exact {:>10.2f} Mrows/s  filter {:>10.2f} Mrows/s\n", "reference", exact_reference / 1e6, filter_reference / 1e6);
+
+    std::vector<u64> matches{};
+    for (const auto backend : { key_scan::Backend::Scalar, key_scan::Backend::SSE2, key_scan::Backend::AVX2 }) {
+        if (!key_scan::IsSupported(backend)) {
+            continue;
+        }
+        const double exact = MeasureRowsPerSecond(mIterations, row_count, [&] {
+            exact_sink = key_scan::FindExact(model->key_table, row_count, row_width, key, backend);
+        });
+        const double filter = MeasureRowsPerSecond(mIterations, row_count, [&] {
+            key_scan::Run(program, model->key_table, row_count, row_width, matches, backend);
+            filter_sink = matches.size();
+        });
+        std::cout << std::format("  {:<10} exact {:>10.2f} Mrows/s  filter {:>10.2f} Mrows/s\n", key_scan::GetBackendName(backend), exact / 1e6, filter / 1e6);
+    }
+
+    const auto build_start = std::chrono::steady_clock::now();
+    const OptionBitmapIndex& bitmaps = mContext.GetShaderArchive().GetOptionBitmaps(model);
+    const double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+    std::vector<OptionBitmapIndex::Term> terms{};
+    for (const auto& constraint : constraints) {
+        terms.push_back({ constraint.GetOptionSlot(bitmaps, model), constraint.values });
+    }
+    const double bitmap_filter = MeasureRowsPerSecond(mIterations, row_count, [&] {
+        bitmaps.Select(terms, matches);
+        filter_sink = matches.size();
+    });
+    std::cout << std::format("  {:<10} filter {:>10.2f} Mrows/s (built in {:.3f} ms, {:#x} bytes)\n", "bitmaps", bitmap_filter / 1e6, build_ms, bitmaps.GetByteSize());
+}
+
+bool SelectionIndexBuilder::Initialize() {
+    if (mInitialized)
+        return mInitialized;
+
+    // the builder reads everything through views, so the archive is never relocated or copied
+    if (!mContext.InitializeShaderArchiveView(mArchivePath)) {
+        std::cout << "Failed to load shader archive\n";
+        return false;
+    }
+
+    mInitialized = true;
+    return true;
+}
+
+void SelectionIndexBuilder::Run() {
+    if (!Initialize())
+        return;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    const std::span<const u8> source = mContext.mShaderArchiveStorage.GetSpan();
+    const std::vector<u8> index = selection_index::Build(mContext.GetShaderArchiveView(), selection_index::ComputeFingerprint(source), source.size());
+    if (!mContext.WriteFile(mOutputPath, index))
+        throw std::runtime_error(std::format("Failed to write {}", mOutputPath));
+
+    std::cout << std::format("Wrote {} ({:#x} bytes, {:.1f}% of {})\n", mOutputPath, index.size(), 100.0 * index.size() / source.size(), mArchivePath);
+
+    if (AppContext::sReportTiming) {
+        std::cout << std::format("Built selection index in {:.3f} ms\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+}
+
+bool MaterialQuery::Initialize() {
+    if (mInitialized)
+        return mInitialized;
+
+    if (!mDatabase.Open(mDatabasePath)) {
+        std::cout << "Failed to load material database\n";
+        return false;
+    }
+
+    mInitialized = true;
+    return true;
+}
+
+std::vector<u32> MaterialQuery::CollectCandidates() const {
+    // start from the most selective index available, the remaining conditions are checked on each candidate
+    std::vector<u32> candidates{};
+    if (mProgramIndex >= 0 || mMaterialName != "") {
+        const auto entries = mProgramIndex >= 0 ? mDatabase.FindMaterialsByProgram(mProgramIndex) : mDatabase.FindMaterialsByName(mMaterialName);
+        candidates.reserve(entries.size());
+        for (const auto& entry : entries)
+            candidates.push_back(entry.material);
+    } else if (mFileName != "") {
+        const material_db::File* file = mDatabase.FindFile(mFileName);
+        if (file == nullptr)
+            return candidates;
+
+        for (const auto& material : mDatabase.GetMaterials(*file))
+            candidates.push_back(mDatabase.GetIndex(material));
+    } else {
+        candidates.resize(mDatabase.GetMaterials().size());
+        std::iota(candidates.begin(), candidates.end(), 0u);
+    }
+    return candidates;
+}
+
+bool MaterialQuery::Matches(const material_db::Material& material) const {
+    if (mFileName != "" && mDatabase.GetString(mDatabase.GetFiles()[material.file].name) != mFileName)
+        return false;
+
+    if (mModelName != "" && mDatabase.GetString(mDatabase.GetModels()[material.model].name) != mModelName)
+        return false;
+
+    if (mMaterialName != "" && mDatabase.GetString(material.name) != mMaterialName)
+        return false;
+
+    if (mProgramIndex >= 0) {
+        const auto variants = mDatabase.GetVariants(material);
+        return std::any_of(variants.begin(), variants.end(), [this](const material_db::Variant& variant) { return variant.program_index == mProgramIndex; });
+    }
+
+    return true;
+}
+
+void MaterialQuery::Run() {
+    if (!Initialize())
+        return;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::ofstream file_out{};
+    if (mOutputPath != "")
+        file_out.open(mOutputPath, IsBinaryFormat(mFormat) ? std::ios::out | std::ios::binary : std::ios::out);
+    std::ostream& out = mOutputPath != "" ? file_out : std::cout;
+
+    // candidates are in database order, so each file's matches are next to each other and can be written as one member
+    const auto materials = mDatabase.GetMaterials();
+    std::vector<u32> matches{};
+    size_t file_count = 0;
+    for (const u32 index : CollectCandidates()) {
+        if (!Matches(materials[index]))
+            continue;
+
+        if (matches.empty() || materials[matches.back()].file != materials[index].file)
+            ++file_count;
+        matches.push_back(index);
+    }
+
+    JsonObjectWriter writer(out, MaterialParser::cDefaultLayout, mFormat, file_count);
+    json file_info = json({});
+    u32 current_file = material_db::cInvalidId;
+    for (const u32 index : matches) {
+        const auto& material = materials[index];
+        if (material.file != current_file) {
+            if (current_file != material_db::cInvalidId)
+                writer.Write(mDatabase.GetString(mDatabase.GetFiles()[current_file].name), file_info);
+            file_info = json({});
+            current_file = material.file;
         }
+
+        file_info[mDatabase.GetString(mDatabase.GetModels()[material.model].name)][mDatabase.GetString(material.name)] = mDatabase.GetInfo(material);
+    }
+    if (current_file != material_db::cInvalidId)
+        writer.Write(mDatabase.GetString(mDatabase.GetFiles()[current_file].name), file_info);
+    writer.Finish();
+
+    std::cerr << std::format("{} of {} material(s) matched\n", matches.size(), materials.size());
+
+    if (AppContext::sReportTiming) {
+        std::cerr << std::format("Answered query in {:.3f} ms\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
     }
 }
 
@@ -493,33 +1350,37 @@ void ShaderInfoPrinter::ProcessModel(ordered_json& output, const g3d2::ResShadin
     }
 
     if (mDumpOptions) {
-        json static_options = {};
-        for (size_t i = 0; i < model->static_option_count; ++i) {
-            const auto& opt = model->static_option_array[i];
-            const std::string_view name = opt.name->Get();
-            static_options[name] = { { "Values", json::array() } };
-            for (size_t j = 0; j < opt.choice_count; ++j) {
-                static_options[name]["Values"].push_back(opt.choice_dict->entries[j + 1].key->Get());
-                if (j == opt.default_choice) {
-                    static_options[name]["Default"] = opt.choice_dict->entries[j + 1].key->Get();
-                }
+        ProcessOptions(output, model);
+    }
+}
+
+void ShaderInfoPrinter::ProcessOptions(ordered_json& output, const g3d2::ResShadingModel* model) {
+    json static_options = {};
+    for (size_t i = 0; i < model->static_option_count; ++i) {
+        const auto& opt = model->static_option_array[i];
+        const std::string_view name = opt.name->Get();
+        static_options[name] = { { "Values", json::array() } };
+        for (size_t j = 0; j < opt.choice_count; ++j) {
+            static_options[name]["Values"].push_back(opt.choice_dict->entries[j + 1].key->Get());
+            if (j == opt.default_choice) {
+                static_options[name]["Default"] = opt.choice_dict->entries[j + 1].key->Get();
             }
         }
-        json dynamic_options = {};
-        for (size_t i = 0; i < model->dynamic_option_count; ++i) {
-            const auto& opt = model->dynamic_option_array[i];
-            const std::string_view name = opt.name->Get();
-            dynamic_options[name] = { { "Values", json::array() } };
-            for (size_t j = 0; j < opt.choice_count; ++j) {
-                dynamic_options[name]["Values"].push_back(opt.choice_dict->entries[j + 1].key->Get());
-                if (j == opt.default_choice) {
-                    dynamic_options[name]["Default"] = opt.choice_dict->entries[j + 1].key->Get();
-                }
+    }
+    json dynamic_options = {};
+    for (size_t i = 0; i < model->dynamic_option_count; ++i) {
+        const auto& opt = model->dynamic_option_array[i];
+        const std::string_view name = opt.name->Get();
+        dynamic_options[name] = { { "Values", json::array() } };
+        for (size_t j = 0; j < opt.choice_count; ++j) {
+            dynamic_options[name]["Values"].push_back(opt.choice_dict->entries[j + 1].key->Get());
+            if (j == opt.default_choice) {
+                dynamic_options[name]["Default"] = opt.choice_dict->entries[j + 1].key->Get();
             }
         }
-        output["Static Options"] = static_options;
-        output["Dynamic Options"] = dynamic_options;
     }
+    output["Static Options"] = static_options;
+    output["Dynamic Options"] = dynamic_options;
 }
 
 static u32 GetInterfaceSlot(const g3d2::ResShadingModel* model, const s32* slots, int index) {
@@ -547,16 +1408,16 @@ void ShaderInfoPrinter::Run() {
     if (!Initialize())
         return;
     
-    const auto shader_file = mContext.GetShaderArchive();
+    const ShaderArchive& archive = mContext.GetShaderArchive();
     
     ordered_json output = {};
-    output["Archive Name"] = shader_file->archive->name->Get();
+    output["Archive Name"] = archive.GetName();
     if (mProgramIndex < 0) {
         if (mModelName == "") {
             // dump all shading models
             output["Models"] = {};
-            for (size_t i = 0; i < shader_file->archive->shading_model_count; ++i) {
-                const g3d2::ResShadingModel* model = shader_file->archive->shading_model_array + i;
+            for (size_t i = 0; i < archive.GetModelCount(); ++i) {
+                const g3d2::ResShadingModel* model = archive.GetModel(i);
                 const std::string_view name = model->name->Get();
                 ordered_json info = ordered_json();
                 ProcessModel(info, model);
@@ -564,13 +1425,7 @@ void ShaderInfoPrinter::Run() {
             }
         } else {
             // dump only the specified model
-            g3d2::ResShadingModel* model = nullptr;
-            for (size_t i = 0; i < shader_file->archive->shading_model_count; ++i) {
-                if (shader_file->archive->shading_model_array[i].name->Get() == mModelName) {
-                    model = shader_file->archive->shading_model_array + i;
-                    break;
-                }
-            }
+            const g3d2::ResShadingModel* model = archive.FindModel(mModelName);
             if (model == nullptr) {
                 std::cout << "No shading model named " << mModelName << "\n";
                 return;
@@ -579,13 +1434,7 @@ void ShaderInfoPrinter::Run() {
             ProcessModel(output, model);
         }
     } else {
-        g3d2::ResShadingModel* model = nullptr;
-        for (size_t i = 0; i < shader_file->archive->shading_model_count; ++i) {
-            if (shader_file->archive->shading_model_array[i].name->Get() == mModelName) {
-                model = shader_file->archive->shading_model_array + i;
-                break;
-            }
-        }
+        const g3d2::ResShadingModel* model = archive.FindModel(mModelName);
         if (model == nullptr) {
             std::cout << "No shading model named " << mModelName << "\n";
             return;
@@ -599,13 +1448,14 @@ void ShaderInfoPrinter::Run() {
         output["Program Index"] = mProgramIndex;
 
         const auto& program = model->program_array[mProgramIndex];
+        const auto* variation = archive.GetVariation(model, mProgramIndex);
 
-        if (program.variation->binary == nullptr) {
+        if (variation->binary == nullptr) {
             std::cout << std::format("No associated shader binary with program index {} for model {}\n", mProgramIndex, model->name->Get());
             return;
         }
 
-        const auto* ifc_table = program.variation->binary->interfaces;
+        const auto* ifc_table = variation->binary->interfaces;
 
         for (u32 stage = 0; stage < gfx::ShaderStage_End; ++stage) {
             const auto* table = ifc_table->stages[stage];
@@ -625,12 +1475,12 @@ void ShaderInfoPrinter::Run() {
                 }
                 stage_info[cInterfaceTypeNames[ifc_type]] = std::move(ifc_info);
             }
-            const auto* code_ptr = program.variation->binary->shader_code_ptrs[stage];
+            const auto* code_ptr = variation->binary->shader_code_ptrs[stage];
             stage_info["Code Size"] = code_ptr->code_size;
             stage_info["Control Size"] = code_ptr->control_size;
             output[cShaderStageNames[stage]] = std::move(stage_info);
             if (mDumpBin) {
-                const std::string basename = std::format("{}_{}_{}_{}", shader_file->archive->name->Get(), model->name->Get(), mProgramIndex, cShaderStageNames[stage]);
+                const std::string basename = std::format("{}_{}_{}_{}", archive.GetName(), model->name->Get(), mProgramIndex, cShaderStageNames[stage]);
                 const Path dir = Path(mOutputPath).parent_path();
                 const std::string code_name = (dir / Path(std::format("{}_code.bin", basename))).string();
                 const std::string control_name = (dir / Path(std::format("{}_control.bin", basename))).string();
@@ -719,10 +1569,10 @@ void ShaderInfoPrinter::Run() {
     }
 
     if (mOutputPath != "-") {
-        std::ofstream out(mOutputPath);
-        out << std::setw(2) << output << std::endl;
+        std::ofstream out(mOutputPath, IsBinaryFormat(mFormat) ? std::ios::out | std::ios::binary : std::ios::out);
+        WriteDocument(out, output, mFormat);
     } else {
-        std::cout << std::setw(2) << output << std::endl;
+        WriteDocument(std::cout, output, mFormat);
     }
 }
 
@@ -731,7 +1581,8 @@ bool ShaderExtractor::Initialize() {
     if (mInitialized)
         return mInitialized;
 
-    if (!mContext.InitializeShaderArchive(mArchivePath)) {
+    // extraction only reads the archive, so it doesn't need a writable copy or relocation at all
+    if (!mContext.InitializeShaderArchiveView(mArchivePath)) {
         std::cout << "Failed to load shader archive\n";
         return false;
     }
@@ -740,66 +1591,62 @@ bool ShaderExtractor::Initialize() {
     return true;
 }
 
+bool ShaderExtractor::ExtractProgram(const ResShadingModelView& model, std::string_view archive_name, size_t index) const {
+    // offsets inside the embedded BNSH are relative to the start of the BNSH rather than the archive
+    const auto shader = model.Get(&g3d2::ResShadingModel::shader);
+    const auto variation = model.Get(&g3d2::ResShadingModel::program_array)[index].Get(&g3d2::ResShaderProgram::variation).Rebase(shader);
+    const auto binary = variation.Get(&gfx::ResShaderVariation::binary);
+    if (!binary) {
+        return false;
+    }
+
+    for (u32 stage = 0; stage < gfx::ShaderStage_End; ++stage) {
+        const auto code_ptr = binary.Get(&gfx::ResShaderProgram::shader_code_ptrs, stage);
+        if (!code_ptr) {
+            continue;
+        }
+        const std::string basename = std::format("{}_{}_{}_{}", archive_name, model.GetString(&g3d2::ResShadingModel::name), index, cShaderStageNames[stage]);
+        const Path dir = Path(mOutputPath);
+        const std::string code_name = (dir / Path(std::format("{}_code.bin", basename))).string();
+        const std::string control_name = (dir / Path(std::format("{}_control.bin", basename))).string();
+        mContext.WriteFile(code_name, { code_ptr.Get(&gfx::ResShaderCode::code).GetData(), code_ptr->code_size });
+        mContext.WriteFile(control_name, { code_ptr.Get(&gfx::ResShaderCode::control).GetData(), code_ptr->control_size });
+    }
+
+    return true;
+}
+
 void ShaderExtractor::Run() {
     if (!Initialize())
         return;
     
-    const auto shader_file = mContext.GetShaderArchive();
-    g3d2::ResShadingModel* model = nullptr;
-    for (size_t i = 0; i < shader_file->archive->shading_model_count; ++i) {
-        if (shader_file->archive->shading_model_array[i].name->Get() == mModelName) {
-            model = shader_file->archive->shading_model_array + i;
+    const auto archive = mContext.GetShaderArchiveView().Get(&g3d2::ResShaderFile::archive);
+    const auto models = archive.Get(&g3d2::ResShaderArchive::shading_model_array);
+    ResShadingModelView model{};
+    for (size_t i = 0; i < archive->shading_model_count; ++i) {
+        if (models[i].GetString(&g3d2::ResShadingModel::name) == mModelName) {
+            model = models[i];
             break;
         }
     }
-    if (model == nullptr) {
+    if (!model) {
         std::cout << "No shading model named " << mModelName << "\n";
         return;
     }
+    const std::string_view archive_name = archive.GetString(&g3d2::ResShaderArchive::name);
     if (mProgramIndex < 0) {
         for (size_t i = 0; i < model->shader_program_count; ++i) {
-            const auto& program = model->program_array[i];
-            if (program.variation->binary == nullptr) {
-                continue;
-            }
-        
-            for (u32 stage = 0; stage < gfx::ShaderStage_End; ++stage) {
-                const auto* code_ptr = program.variation->binary->shader_code_ptrs[stage];
-                if (code_ptr == nullptr) {
-                    continue;
-                }
-                const std::string basename = std::format("{}_{}_{}_{}", shader_file->archive->name->Get(), model->name->Get(), i, cShaderStageNames[stage]);
-                const Path dir = Path(mOutputPath);
-                const std::string code_name = (dir / Path(std::format("{}_code.bin", basename))).string();
-                const std::string control_name = (dir / Path(std::format("{}_control.bin", basename))).string();
-                mContext.WriteFile(code_name, { code_ptr->code, code_ptr->code_size });
-                mContext.WriteFile(control_name, { code_ptr->control, code_ptr->control_size });
-            }
+            ExtractProgram(model, archive_name, i);
         }
     } else {
         if (mProgramIndex >= model->shader_program_count) {
-            std::cout << std::format("Out of range program index for model {}: {}\n", model->name->Get(), mProgramIndex);
+            std::cout << std::format("Out of range program index for model {}: {}\n", mModelName, mProgramIndex);
             return;
         }
 
-        const auto& program = model->program_array[mProgramIndex];
-        
-        if (program.variation->binary == nullptr) {
+        if (!ExtractProgram(model, archive_name, mProgramIndex)) {
             std::cout << "No binary associated with this program\n";
             return;
         }
-
-        for (u32 stage = 0; stage < gfx::ShaderStage_End; ++stage) {
-            const auto* code_ptr = program.variation->binary->shader_code_ptrs[stage];
-            if (code_ptr == nullptr) {
-                continue;
-            }
-            const std::string basename = std::format("{}_{}_{}_{}", shader_file->archive->name->Get(), model->name->Get(), mProgramIndex, cShaderStageNames[stage]);
-            const Path dir = Path(mOutputPath);
-            const std::string code_name = (dir / Path(std::format("{}_code.bin", basename))).string();
-            const std::string control_name = (dir / Path(std::format("{}_control.bin", basename))).string();
-            mContext.WriteFile(code_name, { code_ptr->code, code_ptr->code_size });
-            mContext.WriteFile(control_name, { code_ptr->control, code_ptr->control_size });
-        }
     }
 }
\ No newline at end of file
@@ -1,25 +1,144 @@
 #include "binary_file.h"
 
-void RelocationTable::Relocate() {
+#include "key_scan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define RELOCATE_X64 1
+#include <immintrin.h>
+#endif
+
+#if defined(RELOCATE_X64) && !defined(_MSC_VER)
+#define RELOCATE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RELOCATE_TARGET(isa)
+#endif
+
+using RelocateRunFunc = void (*)(uintptr_t* dest, u32 count, uintptr_t offset);
+
+// adds the offset to every non-null pointer in a contiguous run, sse2 is part of x86-64 so it needs no check
+static void RelocateRunSSE2(uintptr_t* dest, u32 count, uintptr_t offset) {
+#if defined(RELOCATE_X64)
+    const __m128i add128 = _mm_set1_epi64x(static_cast<s64>(offset));
+    const __m128i zero128 = _mm_setzero_si128();
+    for (; count >= 2; count -= 2, dest += 2) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest));
+        // no 64-bit compare in SSE2, a 64-bit lane is null if both of its 32-bit halves are
+        const __m128i half_null = _mm_cmpeq_epi32(values, zero128);
+        const __m128i is_null = _mm_and_si128(half_null, _mm_shuffle_epi32(half_null, _MM_SHUFFLE(2, 3, 0, 1)));
+        values = _mm_add_epi64(values, _mm_andnot_si128(is_null, add128));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), values);
+    }
+#endif
+    for (; count > 0; --count, ++dest)
+        *dest += *dest != 0 ? offset : 0;
+}
+
+#if defined(RELOCATE_X64)
+RELOCATE_TARGET("avx2")
+static void RelocateRunAVX2(uintptr_t* dest, u32 count, uintptr_t offset) {
+    const __m256i add = _mm256_set1_epi64x(static_cast<s64>(offset));
+    const __m256i zero = _mm256_setzero_si256();
+    for (; count >= 4; count -= 4, dest += 4) {
+        __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest));
+        const __m256i is_null = _mm256_cmpeq_epi64(values, zero);
+        values = _mm256_add_epi64(values, _mm256_andnot_si256(is_null, add));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), values);
+    }
+
+    for (; count > 0; --count, ++dest)
+        *dest += *dest != 0 ? offset : 0;
+}
+#endif
+
+// picked once, the cpu check is shared with the key scan backends
+static RelocateRunFunc GetRelocateRun() {
+    static const RelocateRunFunc func = [] {
+#if defined(RELOCATE_X64)
+        if (key_scan::IsSupported(key_scan::Backend::AVX2))
+            return &RelocateRunAVX2;
+#endif
+        return &RelocateRunSSE2;
+    }();
+    return func;
+}
+
+struct RelocationChunk {
+    size_t offset;
+    s32 first_entry;
+    s32 entry_count;
+};
+
+static u64 RelocateEntries(const RelocationTable* table, uintptr_t base, const RelocationChunk& chunk) {
+    const RelocateRunFunc relocate_run = GetRelocateRun();
+    u64 pointer_count = 0;
+    for (s32 i = 0; i < chunk.entry_count; ++i) {
+        const auto entry = table->GetEntry(chunk.first_entry + i);
+        uintptr_t* dest = reinterpret_cast<uintptr_t*>(base + entry->position);
+        for (u32 k = 0; k < entry->array_count; ++k) {
+            relocate_run(dest, entry->relocation_count, chunk.offset);
+            dest += entry->relocation_count + entry->stride;
+        }
+        pointer_count += static_cast<u64>(entry->array_count) * entry->relocation_count;
+    }
+    return pointer_count;
+}
+
+void RelocationTable::Relocate(RelocationStats* out_stats, u32 max_threads) {
+    const auto start = std::chrono::steady_clock::now();
+
     uintptr_t base = reinterpret_cast<uintptr_t>(this) - this_offset;
 
+    std::vector<RelocationChunk> chunks{};
+    s32 total_entry_count = 0;
     for (s32 i = 0; i < section_count; ++i) {
         const auto section = GetSection(i);
         const size_t offset = section->ptr != nullptr ? section->offset - section->position : base;
 
-        for (s32 j = 0; j < section->entry_count; ++j) {
-            const auto entry = GetEntry(section->base_entry_index + j);
-            uintptr_t* dest = reinterpret_cast<uintptr_t*>(base + entry->position);
-            for (u32 k = 0; k < entry->array_count; ++k) {
-                for (u8 l = 0; l < entry->relocation_count; ++l) {
-                    if (*dest != 0)
-                        *dest += offset;
-                    ++dest;
-                }
-                dest += entry->stride;
-            }
+        for (s32 j = 0; j < section->entry_count; j += cEntriesPerChunk) {
+            chunks.push_back({ offset, section->base_entry_index + j, std::min(cEntriesPerChunk, section->entry_count - j) });
         }
+        total_entry_count += section->entry_count;
+    }
+
+    // every pointer only appears in a single entry so chunks can be relocated independently
+    u32 thread_count = 1;
+    if (max_threads > 1 && total_entry_count >= cParallelEntryThreshold) {
+        thread_count = std::clamp(std::min({ std::thread::hardware_concurrency(), max_threads, cMaxThreadCount }), 1u, static_cast<u32>(chunks.size()));
+    }
+
+    u64 pointer_count = 0;
+    if (thread_count <= 1) {
+        for (const auto& chunk : chunks)
+            pointer_count += RelocateEntries(this, base, chunk);
+    } else {
+        std::atomic<size_t> next_chunk = 0;
+        std::atomic<u64> total_pointer_count = 0;
+        std::vector<std::thread> threads{};
+        threads.reserve(thread_count);
+        for (u32 i = 0; i < thread_count; ++i) {
+            threads.emplace_back([&] {
+                u64 count = 0;
+                for (size_t index = next_chunk++; index < chunks.size(); index = next_chunk++)
+                    count += RelocateEntries(this, base, chunks[index]);
+                total_pointer_count += count;
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        pointer_count = total_pointer_count;
     }
 
     reinterpret_cast<BinaryFileHeader*>(base)->SetRelocated(true);
+
+    if (out_stats != nullptr) {
+        out_stats->entry_count += static_cast<u64>(total_entry_count);
+        out_stats->pointer_count += pointer_count;
+        out_stats->thread_count = std::max(out_stats->thread_count, thread_count);
+        out_stats->duration += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    }
 }
\ No newline at end of file
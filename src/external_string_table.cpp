@@ -0,0 +1,79 @@
+#include "external_string_table.h"
+
+#include <algorithm>
+#include <bit>
+
+static inline void Prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#else
+    static_cast<void>(address);
+#endif
+}
+
+u64 ExternalStringTable::HashKey(u64 key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+void ExternalStringTable::Build(const ResFile* external_strings) {
+    mDefaultString = external_strings->default_string;
+    mCount = external_strings->external_strings->node_count;
+
+    // keep the load factor at or below 50% so probe sequences stay short
+    const size_t capacity = std::bit_ceil(std::max<size_t>(mCount * 2, 16));
+    mSlots.assign(capacity, { 0, nullptr });
+    mMask = capacity - 1;
+
+    for (size_t i = 0; i < mCount; ++i) {
+        const u64 key = external_strings->external_string_keys[i];
+        for (u64 slot = HashKey(key) & mMask;; slot = (slot + 1) & mMask) {
+            auto& entry = mSlots[slot];
+            if (entry.string == nullptr) {
+                entry = { key, external_strings->external_strings->entries[i + 1].key };
+                break;
+            }
+            // the keys are sorted, a duplicate resolves to the first one like the binary search did
+            if (entry.key == key)
+                break;
+        }
+    }
+}
+
+void ExternalStringTable::Resolve(std::span<BinString** const> slots) const {
+    if (mSlots.empty()) {
+        for (BinString** slot : slots)
+            *slot = const_cast<BinString*>(mDefaultString);
+        return;
+    }
+
+    u64 first_slots[cBatchSize];
+    for (size_t begin = 0; begin < slots.size(); begin += cBatchSize) {
+        const size_t count = std::min(cBatchSize, slots.size() - begin);
+
+        for (size_t i = 0; i < count; ++i) {
+            first_slots[i] = HashKey(reinterpret_cast<u64>(*slots[begin + i])) & mMask;
+            Prefetch(&mSlots[first_slots[i]]);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            BinString*& string = *slots[begin + i];
+            const u64 key = reinterpret_cast<u64>(string);
+            for (u64 slot = first_slots[i];; slot = (slot + 1) & mMask) {
+                const auto& entry = mSlots[slot];
+                if (entry.string == nullptr) {
+                    string = const_cast<BinString*>(mDefaultString);
+                    break;
+                }
+                if (entry.key == key) {
+                    string = const_cast<BinString*>(entry.string);
+                    break;
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
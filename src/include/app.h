@@ -2,14 +2,32 @@
 
 #include "bfres.h"
 #include "bfsha.h"
+#include "external_string_table.h"
+#include "json_writer.h"
+#include "key_scan.h"
+#include "local_socket.h"
+#include "mapped_file.h"
+#include "material_db.h"
+#include "ordered_pipeline.h"
+#include "res_view.h"
+#include "search_plan.h"
+#include "selection_cache.h"
+#include "selection_index.h"
 #include "shader.h"
+#include "thread_pool.h"
+#include "work_memory.h"
 
 #include <nlohmann/json.hpp>
 
+#include <atomic>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <ranges>
 #include <span>
 #include <stdexcept>
@@ -24,69 +42,105 @@ struct AppContext {
 public:
     AppContext() {}
 
-    const ResFile* GetExternalBinaryString() {
-        if (mShaderArchiveStorage.empty()) {
-            throw std::runtime_error("Tried to access external binary strings before initialization!");
+    const ShaderArchive& GetShaderArchive() const {
+        if (!mShaderArchive.IsInitialized()) {
+            throw std::runtime_error("Tried to access shader archive before initialization!");
         }
-        return ResFile::ResCast(mExternalBinaryStringStorage.data());
+        return mShaderArchive;
     }
 
-    const g3d2::ResShaderFile* GetShaderArchive() {
-        if (mShaderArchiveStorage.empty()) {
+    ResShaderFileView GetShaderArchiveView() const {
+        if (mShaderArchiveStorage.IsEmpty()) {
             throw std::runtime_error("Tried to access shader archive before initialization!");
         }
-        return g3d2::ResShaderFile::ResCast(mShaderArchiveStorage.data());
+        return ResShaderFileView(mShaderArchiveStorage.GetData());
     }
 
-    static bool ReadFile(const std::string path, std::vector<u8>& data);
+    static bool ReadFile(const std::string path, MappedFile& data,
+                         MappedFile::Access access = MappedFile::Access::CopyOnWrite,
+                         MappedFile::Advice advice = MappedFile::Advice::Normal);
 
-    static void WriteFile(const std::string path, const std::span<const u8>& data);
+    // false if the file couldn't be opened or not all of the data could be written (e.g. the disk is full)
+    static bool WriteFile(const std::string path, const std::span<const u8>& data);
 
-    static bool DecompressFile(const std::string path, std::vector<u8>& data);
+    // safe to call concurrently, each call borrows its own work memory from the pool
+    bool DecompressFile(const std::string path, std::vector<u8>& data);
 
-    ResFile* SetupFile(void* file_data) {
-        ResFile* file = ResFile::ResCast(file_data);
+    bool DecompressData(const std::span<const u8>& compressed, std::vector<u8>& data);
 
-        if (!file->IsRelocatedExternalStrings())
-            file->RelocateExternalStrings(GetExternalBinaryString());
-        
-        if (!file->IsRelocatedExternalStrings())
-            return nullptr;
+    const WorkMemoryPool& GetWorkMemoryPool() const { return mWorkMemoryPool; }
 
-        return file;
-    }
+    ResFile* SetupFile(void* file_data);
 
+    // also builds the key -> string table every file's external strings are resolved through
     bool InitializeExternalBinaryString(const std::string& path) {
         if (!DecompressFile(path, mExternalBinaryStringStorage)) {
             std::cout << "Failed to open " << path << "\n";
             return false;
         }
         
-        return ResFile::ResCast(mExternalBinaryStringStorage.data()) != nullptr;
+        const ResFile* file = ResFile::ResCast(mExternalBinaryStringStorage.data());
+        if (file == nullptr)
+            return false;
+
+        mExternalStringTable.Build(file);
+        return true;
     }
 
-    bool InitializeShaderArchive(const std::string& path) {
-        if (!ReadFile(path, mShaderArchiveStorage)) {
+    bool InitializeShaderArchive(const std::string& path);
+
+    // loads a selection index built with `mat-tool index build` in place of the full shader archive
+    // if the source archive is present, the index is checked against it so a stale index isn't silently used
+    bool InitializeSelectionIndex(const std::string& path, const std::string& archive_path);
+
+    // maps the archive read-only without relocating it, it can then only be accessed through GetShaderArchiveView
+    bool InitializeShaderArchiveView(const std::string& path) {
+        if (!ReadFile(path, mShaderArchiveStorage, MappedFile::Access::ReadOnly, MappedFile::Advice::Random)) {
             std::cout << "Failed to open " << path << "\n";
             return false;
         }
 
-        return g3d2::ResShaderFile::ResCast(mShaderArchiveStorage.data()) != nullptr;
+        return mShaderArchiveStorage.GetSize() >= sizeof(g3d2::ResShaderFile)
+               && !reinterpret_cast<const BinaryFileHeader*>(mShaderArchiveStorage.GetData())->IsRelocated();
     }
 
+    // total relocation cost of all files set up through SetupFile
+    RelocationStats GetFileRelocationStats() const {
+        std::lock_guard lock(mStatsMutex);
+        return mFileRelocationStats;
+    }
+
+    static void PrintRelocationStats(const std::string_view name, const RelocationStats& stats);
+
+    // set with --timing, reports load and relocation times
+    static inline bool sReportTiming = false;
+
     std::vector<u8> mExternalBinaryStringStorage{};
-    std::vector<u8> mShaderArchiveStorage{};
+    ExternalStringTable mExternalStringTable{};
+    MappedFile mShaderArchiveStorage{};
+    ShaderArchive mShaderArchive{};
+    WorkMemoryPool mWorkMemoryPool{};
+    RelocationStats mFileRelocationStats{};
+    mutable std::mutex mStatsMutex;
     bool mInitialized = false;
 };
 
 class MaterialParser {
 public:
+    // a material's sampler, texture and skin count lists are written on one line each
+    static inline const JsonLayout cDefaultLayout{ 2, { "*/*/*/Samplers", "*/*/*/Skin Counts", "*/*/*/Textures" } };
+
     MaterialParser() = delete;
     explicit MaterialParser(const std::string_view romfs_path,
                             const std::string_view material_archive_path = "",
                             const std::string_view external_binary_string_path = "",
-                            const std::string_view output_path = "")
-        : mRomfsPath(romfs_path), mMaterialArchivePath(material_archive_path), mExternalBinaryStringPath(external_binary_string_path), mOutputPath(output_path) {
+                            const std::string_view output_path = "",
+                            u32 job_count = 1,
+                            const std::string_view selection_index_path = "",
+                            const JsonLayout& layout = cDefaultLayout,
+                            OutputFormat format = OutputFormat::Json)
+        : mRomfsPath(romfs_path), mMaterialArchivePath(material_archive_path), mExternalBinaryStringPath(external_binary_string_path), mOutputPath(output_path),
+          mSelectionIndexPath(selection_index_path), mLayout(layout), mFormat(format), mJobCount(job_count) {
         if (mMaterialArchivePath == "") {
             mMaterialArchivePath = "material.Product.140.product.Nin_NX_NVN.bfsha";
         }
@@ -94,7 +148,10 @@ public:
             mExternalBinaryStringPath = (Path(mRomfsPath) / Path("Shader") / Path("ExternalBinaryString.bfres.mc")).string();
         }
         if (mOutputPath == "") {
-            mOutputPath = "Materials.json";
+            mOutputPath = std::format("Materials{}", GetFileExtension(mFormat));
+        }
+        if (mJobCount == 0) {
+            mJobCount = ThreadPool::GetDefaultThreadCount();
         }
     }
 
@@ -102,13 +159,48 @@ public:
     void Run();
 
 private:
-    void ProcessFile(const std::string path, json& output, bool compressed = true);
+    struct FileEntry {
+        std::string path;
+        std::string filename;
+        size_t size;
+        bool compressed;
+    };
+
+    // data passed between pipeline stages
+    struct FileData {
+        MappedFile source;
+        std::vector<u8> decompressed;
+
+        u8* GetData() {
+            return source.IsEmpty() ? decompressed.data() : source.GetData();
+        }
+    };
+
+    std::vector<FileEntry> CollectFiles() const;
+
+    // pipeline stages: read -> decompress -> parse -> serialize
+    MappedFile ReadStage(const FileEntry& entry) const;
+    void DecompressStage(const FileEntry& entry, FileData& data);
+    json ParseStage(const FileEntry& entry, FileData& data);
+
+    // receives each file's result in filename order
+    using ResultWriter = std::function<void(const FileEntry& entry, const json& info)>;
+
+    void RunSerial(const std::vector<FileEntry>& files, const ResultWriter& write);
+    void RunPipeline(const std::vector<FileEntry>& files, const ResultWriter& write);
 
     std::string mRomfsPath{};
     std::string mMaterialArchivePath{};
     std::string mExternalBinaryStringPath{};
     std::string mOutputPath{};
+    std::string mSelectionIndexPath{};
+    JsonLayout mLayout{};
+    OutputFormat mFormat = OutputFormat::Json;
     AppContext mContext{};
+    // every material is resolved for each skin count, shared by all parse workers
+    SelectionCache mSelectionCache{ ShaderSelector::cWeightName, std::span(ShaderSelector::cNumberNames).first(0x10) };
+    std::mutex mLogMutex;
+    u32 mJobCount = 1;
     bool mInitialized = false;
 };
 
@@ -170,6 +262,35 @@ struct Constraint {
         return false;
     }
 
+    SearchPlan::Term ToTerm() const {
+        return { option, IsDynamic, values };
+    }
+
+    u32 GetOptionSlot(const OptionBitmapIndex& bitmaps, const g3d2::ResShadingModel* model) const {
+        if constexpr (IsDynamic) {
+            return bitmaps.GetDynamicSlot(static_cast<u32>(option - model->dynamic_option_array));
+        } else {
+            return bitmaps.GetStaticSlot(static_cast<u32>(option - model->static_option_array));
+        }
+    }
+
+    // the same test as Match in a form key_scan can evaluate over many rows at once
+    key_scan::Clause ToClause(const g3d2::ResShadingModel* model) const {
+        key_scan::Clause clause{};
+        if constexpr (IsDynamic) {
+            clause.word = model->static_key_count + option->option_index - option->dynamic_index_offset;
+        } else {
+            clause.word = option->option_index;
+        }
+        clause.mask = option->option_mask;
+        for (const auto val : values) {
+            clause.values.push_back((val << option->bit_offset) & option->option_mask);
+        }
+        // assume choices are evenly used until there's something better to go by
+        clause.selectivity = option->choice_count > 0 ? static_cast<f32>(values.size()) / option->choice_count : 1.0f;
+        return clause;
+    }
+
     std::vector<u32> values{};
     g3d2::ResShaderOption* option;
 
@@ -215,8 +336,14 @@ public:
     explicit MaterialSearcher(const std::string config_path,
                               const std::string_view material_archive_path = "",
                               const std::string_view output_path = "",
-                              bool verbose = false)
-            : mConfigPath(config_path), mMaterialArchivePath(material_archive_path), mOutputFileStream(std::string(output_path)), mVerbose(verbose) {
+                              bool verbose = false,
+                              const std::string_view selection_index_path = "",
+                              bool explain = false,
+                              u32 job_count = 1,
+                              OutputFormat format = OutputFormat::Text)
+            : mConfigPath(config_path), mMaterialArchivePath(material_archive_path), mSelectionIndexPath(selection_index_path),
+              mOutputFileStream(std::string(output_path), IsBinaryFormat(format) ? std::ios::out | std::ios::binary : std::ios::out),
+              mFormat(format), mJobCount(job_count), mVerbose(verbose), mExplain(explain) {
         if (mMaterialArchivePath == "") {
             mMaterialArchivePath = "material.Product.140.product.Nin_NX_NVN.bfsha";
         }
@@ -225,23 +352,207 @@ public:
         } else {
             mOutStream = &mOutputFileStream;
         }
+        if (mJobCount == 0) {
+            mJobCount = ThreadPool::GetDefaultThreadCount();
+        }
     }
 
     bool Initialize();
     void Run();
 
+    struct Query {
+        const g3d2::ResShadingModel* model = nullptr;
+        std::vector<Constraint<false>> static_constraints{};
+        std::vector<Constraint<true>> dynamic_constraints{};
+    };
+
+    using OptionList = std::vector<std::pair<std::string_view, std::string_view>>;
+
+    // these only need the archive so the server can answer queries against its resident one
+    // throws if the model or any of the options don't exist
+    static Query ParseQuery(const ShaderArchive& archive, const json& config);
+    static std::vector<u64> Execute(const ShaderArchive& archive, const Query& query, std::ostream* explain_stream);
+
+    // the constrained options of a matching program, or every option not at its default if verbose
+    static void CollectOptions(const Query& query, const u32* keys, bool verbose, OptionList& static_options, OptionList& dynamic_options);
+
+    // fills in Model Name, Match Count, Plan (if explain is set) and Programs for one query config, throws like ParseQuery
+    static void Answer(ordered_json& result, const ShaderArchive& archive, const json& config, bool verbose, bool explain);
+
 private:
-    void Print(const g3d2::ResShadingModel* model, const u32* keys, size_t index) const;
+
+    // one query of a batch, id is the file name (directories) or the "Id" field/line number (JSON Lines)
+    struct BatchEntry {
+        std::string id;
+        json config;
+        std::string error;
+    };
+
+    void Print(const Query& query, const u32* keys, size_t index) const;
+
+    // a directory of configs or a JSON Lines file is answered as a batch, writing one record (see EncodeRecord) per query
+    bool IsBatch() const;
+    std::vector<BatchEntry> LoadBatch() const;
+    std::string RunBatchEntry(const BatchEntry& entry) const;
+    void RunBatch();
 
     std::string mConfigPath{};
     std::string mMaterialArchivePath{};
-    std::vector<Constraint<false>> mStaticConstraints{};
-    std::vector<Constraint<true>> mDynamicConstraints{};
+    std::string mSelectionIndexPath{};
     AppContext mContext{};
     std::ostream* mOutStream = nullptr;
     std::ofstream mOutputFileStream;
+    OutputFormat mFormat = OutputFormat::Text;
+    u32 mJobCount = 1;
     bool mInitialized = false;
     bool mVerbose = false;
+    bool mExplain = false;
+};
+
+// keeps the shader archive loaded and answers newline-delimited JSON requests over a unix domain socket or stdin/stdout
+// every request is an object with an "Action" (select, search, info or shutdown) and an optional "Id" that is echoed back
+class MaterialServer {
+public:
+    MaterialServer() = delete;
+    explicit MaterialServer(const std::string_view material_archive_path = "",
+                            const std::string_view selection_index_path = "",
+                            const std::string_view socket_path = "",
+                            u32 job_count = 1)
+        : mMaterialArchivePath(material_archive_path), mSelectionIndexPath(selection_index_path), mSocketPath(socket_path), mJobCount(job_count) {
+        if (mMaterialArchivePath == "") {
+            mMaterialArchivePath = "material.Product.140.product.Nin_NX_NVN.bfsha";
+        }
+        if (mJobCount == 0) {
+            mJobCount = ThreadPool::GetDefaultThreadCount();
+        }
+    }
+
+    bool Initialize();
+    void Run();
+
+private:
+    struct Client {
+        LocalSocket socket;
+        std::thread thread;
+        std::atomic<bool> done = false;
+    };
+
+    // never throws, failures are reported in the response's "Error" field
+    std::string HandleRequest(const std::string& line);
+
+    void Select(ordered_json& result, const json& request) const;
+    void Info(ordered_json& result, const json& request) const;
+    void Stop();
+
+    // stdin/stdout, up to mJobCount requests are answered at once and responses are written as they finish
+    void ServeStream();
+    // one thread per connected client, each client's requests are answered in order
+    void ServeSocket();
+    void ServeClient(Client& client);
+
+    std::string mMaterialArchivePath{};
+    std::string mSelectionIndexPath{};
+    std::string mSocketPath{};
+    AppContext mContext{};
+    LocalSocket mListener{};
+    LocalSocket mInput{};
+    std::list<Client> mClients{};
+    std::mutex mClientMutex;
+    std::atomic<u64> mRequestCount = 0;
+    std::atomic<u64> mTotalLatency = 0; // in nanoseconds
+    std::atomic<bool> mStopping = false;
+    u32 mJobCount = 1;
+    bool mInitialized = false;
+};
+
+// compares the old scalar key table loops against each key_scan backend on a real shading model
+class ScanBenchmark {
+public:
+    ScanBenchmark() = delete;
+    explicit ScanBenchmark(const std::string_view archive_path = "",
+                           const std::string_view model_name = "",
+                           u32 iterations = 20)
+        : mArchivePath(archive_path), mModelName(model_name), mIterations(iterations) {
+        if (mArchivePath == "") {
+            mArchivePath = "material.Product.140.product.Nin_NX_NVN.bfsha";
+        }
+        if (mModelName == "") {
+            mModelName = "material";
+        }
+        if (mIterations == 0) {
+            mIterations = 1;
+        }
+    }
+
+    bool Initialize();
+    void Run();
+
+private:
+    std::string mArchivePath{};
+    std::string mModelName{};
+    AppContext mContext{};
+    u32 mIterations = 20;
+    bool mInitialized = false;
+};
+
+class SelectionIndexBuilder {
+public:
+    SelectionIndexBuilder() = delete;
+    explicit SelectionIndexBuilder(const std::string_view archive_path = "",
+                                   const std::string_view output_path = "")
+        : mArchivePath(archive_path), mOutputPath(output_path) {
+        if (mArchivePath == "") {
+            mArchivePath = "material.Product.140.product.Nin_NX_NVN.bfsha";
+        }
+        if (mOutputPath == "") {
+            mOutputPath = "SelectionIndex.bin";
+        }
+    }
+
+    bool Initialize();
+    void Run();
+
+private:
+    std::string mArchivePath{};
+    std::string mOutputPath{};
+    AppContext mContext{};
+    bool mInitialized = false;
+};
+
+// answers lookups against a material database written by dump --format matdb, matching materials are written the way dump writes them
+class MaterialQuery {
+public:
+    MaterialQuery() = delete;
+    explicit MaterialQuery(const std::string_view database_path,
+                           const std::string_view output_path = "",
+                           const std::string_view file_name = "",
+                           const std::string_view model_name = "",
+                           const std::string_view material_name = "",
+                           s32 program_index = -1,
+                           OutputFormat format = OutputFormat::Json)
+        : mDatabasePath(database_path), mOutputPath(output_path), mFileName(file_name), mModelName(model_name), mMaterialName(material_name),
+          mProgramIndex(program_index), mFormat(format) {
+        if (mDatabasePath == "") {
+            mDatabasePath = "Materials.matdb";
+        }
+    }
+
+    bool Initialize();
+    void Run();
+
+private:
+    std::vector<u32> CollectCandidates() const;
+    bool Matches(const material_db::Material& material) const;
+
+    std::string mDatabasePath{};
+    std::string mOutputPath{};
+    std::string mFileName{};
+    std::string mModelName{};
+    std::string mMaterialName{};
+    s32 mProgramIndex = -1;
+    OutputFormat mFormat = OutputFormat::Json;
+    MaterialDb mDatabase{};
+    bool mInitialized = false;
 };
 
 class ShaderInfoPrinter {
@@ -252,10 +563,12 @@ public:
                                const std::string_view model_name = "",
                                int program_index = -1,
                                bool dump_options = true,
-                               bool dump_bin = false)
-        : mArchivePath(archive_path), mOutputPath(output_path), mModelName(model_name), mProgramIndex(program_index), mDumpOptions(dump_options), mDumpBin(dump_bin) {
+                               bool dump_bin = false,
+                               OutputFormat format = OutputFormat::Json)
+        : mArchivePath(archive_path), mOutputPath(output_path), mModelName(model_name), mFormat(format), mProgramIndex(program_index), mDumpOptions(dump_options),
+          mDumpBin(dump_bin) {
         if (mOutputPath == "") {
-            mOutputPath = "ShaderInfo.json";
+            mOutputPath = std::format("ShaderInfo{}", GetFileExtension(mFormat));
         }
         if (mProgramIndex >= 0 && mModelName == "") {
             mModelName = "material";
@@ -265,6 +578,9 @@ public:
     bool Initialize();
     void Run();
 
+    // every option of the model with its choices and default choice
+    static void ProcessOptions(ordered_json& output, const g3d2::ResShadingModel* model);
+
 private:
     void ProcessModel(ordered_json& output, const g3d2::ResShadingModel* model) const;
     void ProcessInterfaces(ordered_json& output, const g3d2::ResShadingModel* model, const ResDic* names, BinString* const* interfaces, u16 count) const;
@@ -273,6 +589,7 @@ private:
     std::string mOutputPath{};
     std::string mModelName{};
     AppContext mContext{};
+    OutputFormat mFormat = OutputFormat::Json;
     int mProgramIndex = -1;
     bool mInitialized = false;
     bool mDumpOptions = true;
@@ -296,6 +613,8 @@ public:
     void Run();
 
 private:
+    bool ExtractProgram(const ResShadingModelView& model, std::string_view archive_name, size_t index) const;
+
     std::string mArchivePath{};
     std::string mOutputPath{};
     std::string mModelName{};
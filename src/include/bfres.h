@@ -3,6 +3,8 @@
 #include "binary_file.h"
 #include "math_types.h"
 
+class ExternalStringTable;
+
 struct UserData {
     BinString* name;
     void* data;
@@ -409,11 +411,7 @@ struct ResFile : public BinaryFileHeader {
         options = options & (0xff ^ (relocated << 1));
     }
     
-    // only for use if the file contains external shader strings
-    size_t FindExternalStringIndex(u64 key) const;
-
-    const BinString* RelocateExternalString(BinString*& out_string) const;
-
-    void RelocateExternalStrings(const ResFile* external_strings);
+    // resolves every external string key in the file through the table built from ExternalBinaryString.bfres
+    void RelocateExternalStrings(const ExternalStringTable& table);
 };
 static_assert(sizeof(ResFile) == 0xf0);
\ No newline at end of file
@@ -377,9 +377,7 @@ struct ResShaderFile : public BinaryFileHeader {
             reloc_table->Relocate();
         }
 
-        for (size_t i = 0; i < file->archive->shading_model_count; ++i)
-            ::gfx::ResShaderFile::ResCast(file->archive->shading_model_array[i].shader);
-        
+        // embedded BNSH files are relocated on demand, see ShaderArchive::GetShader
         return file;
     }
 };
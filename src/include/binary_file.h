@@ -2,6 +2,7 @@
 
 #include "types.h"
 
+#include <chrono>
 #include <iterator>
 #include <string_view>
 
@@ -90,7 +91,19 @@ struct BinaryBlockHeader {
     u32 reserved;
 };
 
+struct RelocationStats {
+    u64 entry_count = 0;
+    u64 pointer_count = 0;
+    u32 thread_count = 0;
+    std::chrono::nanoseconds duration{};
+};
+
 struct RelocationTable {
+    // tables with at least this many entries get split across threads, if the caller allows more than one
+    static constexpr s32 cParallelEntryThreshold = 0x10000;
+    static constexpr s32 cEntriesPerChunk = 0x2000;
+    // past this the chunks are done faster than the threads are started
+    static constexpr u32 cMaxThreadCount = 8;
     
     struct Section {
         union {
@@ -115,7 +128,9 @@ struct RelocationTable {
     s32 section_count;
     Section sections[1];
 
-    void Relocate();
+    // max_threads is 1 by default since files are usually relocated by workers that already keep every core busy, callers relocating
+    // a single large file on their own (the shader archive) pass more
+    void Relocate(RelocationStats* out_stats = nullptr, u32 max_threads = 1);
 
     const Section* GetSection(int index) const {
         // no bounds check
@@ -145,6 +160,12 @@ struct ResDic {
         return entry->key->Get() == key ? static_cast<int>(std::distance(&entries[1], entry)) : -1;
     }
 
+    // the index of the only entry that could match the key, the key itself still has to be compared by the caller
+    // the trie walk doesn't touch any pointers so this also works on unrelocated dictionaries
+    int FindCandidateIndex(const std::string_view& key) const {
+        return static_cast<int>(std::distance(&entries[1], FindImpl(key)));
+    }
+
 private:
     static int ExtractRefBit(const std::string_view& key, int ref_bit) {
         int char_index = ref_bit >> 3;
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "types.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// fixed capacity multi-producer multi-consumer queue, producers block while it's full
+template <typename T>
+class BoundedQueue {
+public:
+    BoundedQueue() = delete;
+    explicit BoundedQueue(size_t capacity) : mCapacity(capacity == 0 ? 1 : capacity) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    auto operator=(const BoundedQueue&) = delete;
+
+    // returns false if the queue was closed before the value could be pushed
+    bool Push(T value) {
+        std::unique_lock lock(mMutex);
+        mNotFull.wait(lock, [this] { return mClosed || mItems.size() < mCapacity; });
+        if (mClosed)
+            return false;
+
+        mItems.emplace_back(std::move(value));
+        lock.unlock();
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    // returns std::nullopt once the queue is closed and drained
+    std::optional<T> Pop() {
+        std::unique_lock lock(mMutex);
+        mNotEmpty.wait(lock, [this] { return mClosed || !mItems.empty(); });
+        if (mItems.empty())
+            return std::nullopt;
+
+        std::optional<T> value{ std::move(mItems.front()) };
+        mItems.pop_front();
+        lock.unlock();
+        mNotFull.notify_one();
+        return value;
+    }
+
+    // no more values will be accepted, consumers finish off whatever is left
+    void Close() {
+        {
+            std::lock_guard lock(mMutex);
+            mClosed = true;
+        }
+        mNotFull.notify_all();
+        mNotEmpty.notify_all();
+    }
+
+    size_t GetCapacity() const { return mCapacity; }
+
+private:
+    std::deque<T> mItems{};
+    std::mutex mMutex;
+    std::condition_variable mNotFull;
+    std::condition_variable mNotEmpty;
+    const size_t mCapacity;
+    bool mClosed = false;
+};
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "bfres.h"
+
+#include <span>
+#include <vector>
+
+// ExternalBinaryString.bfres's key -> string table as an open addressing hash table
+// bfres files with external strings store one of these keys in place of some names, resolving them used to mean a binary search
+// over the sorted key array per name, per file; read-only after Build so it can be shared by every worker
+class ExternalStringTable {
+public:
+    ExternalStringTable() = default;
+
+    void Build(const ResFile* external_strings);
+
+    // replaces the key stored in each slot with its string, every key of a batch is hashed and its table slot prefetched before
+    // any of them is probed so the cache misses overlap instead of being taken one at a time
+    void Resolve(std::span<BinString** const> slots) const;
+
+    const BinString* GetDefaultString() const { return mDefaultString; }
+
+    bool IsBuilt() const { return !mSlots.empty(); }
+    size_t GetCount() const { return mCount; }
+    size_t GetCapacity() const { return mSlots.size(); }
+
+    static u64 HashKey(u64 key);
+
+private:
+    struct Slot {
+        u64 key;
+        const BinString* string; // nullptr if the slot is empty
+    };
+
+    static constexpr size_t cBatchSize = 32;
+
+    std::vector<Slot> mSlots{};
+    const BinString* mDefaultString = nullptr;
+    size_t mCount = 0;
+    u64 mMask = 0;
+};
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "types.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+enum class OutputFormat {
+    Json,      // indented text
+    JsonLines, // one compact JSON object per line and record
+    Cbor,
+    MsgPack,
+    MatDb,     // material database, dump only (see material_db.h)
+    Text,      // human readable listing, search only
+};
+
+// false if the name isn't one of json, jsonl, cbor, msgpack, matdb or text
+bool ParseOutputFormat(std::string_view name, OutputFormat& format);
+
+// default file extension for output in the format, including the dot
+std::string_view GetFileExtension(OutputFormat format);
+
+inline bool IsBinaryFormat(OutputFormat format) {
+    return format == OutputFormat::Cbor || format == OutputFormat::MsgPack || format == OutputFormat::MatDb;
+}
+
+// a standalone record: a compact line of JSON for the text formats, a single CBOR/MessagePack item for the binary ones
+// records can be concatenated into a stream (JSON Lines, a CBOR sequence or a MessagePack stream) and split again without any framing
+template <typename BasicJson>
+std::string EncodeRecord(const BasicJson& value, OutputFormat format) {
+    std::string record{};
+    switch (format) {
+        case OutputFormat::Cbor:
+            BasicJson::to_cbor(value, record);
+            break;
+        case OutputFormat::MsgPack:
+            BasicJson::to_msgpack(value, record);
+            break;
+        default:
+            record = value.dump();
+            record += '\n';
+            break;
+    }
+    return record;
+}
+
+// writes a complete document, indented for OutputFormat::Json and a single record otherwise
+template <typename BasicJson>
+void WriteDocument(std::ostream& out, const BasicJson& value, OutputFormat format, int indent = 2) {
+    if (format == OutputFormat::Json) {
+        out << std::setw(indent) << value << std::endl;
+        return;
+    }
+
+    out << EncodeRecord(value, format);
+    out.flush();
+}
+
+// how JsonObjectWriter lays out values, without any inline paths it's the same as dumping with std::setw(indent)
+struct JsonLayout {
+    int indent = 2;
+
+    // key paths of arrays/objects that are written on a single line (e.g. ["a", "b"]), keys are separated by '/' and '*' matches
+    // any key; a path starts at the top level member's key and array elements share their array's path
+    std::vector<std::string> inline_paths{};
+
+    bool IsInline(std::span<const std::string_view> path) const;
+};
+
+// writes a top level JSON object one member at a time, so the whole object never has to be held in memory
+// with the default layout the output is byte for byte what dumping the complete object with std::setw(2) would give, provided
+// members are written in sorted key order (the order nlohmann::json keeps object members in)
+// the other formats write the same object as:
+//   JsonLines: one {"key": value} object per line and member, merging the lines gives back the whole object
+//   Cbor:      an indefinite-length map
+//   MsgPack:   a map, its size has to be known up front and be passed as member_count
+class JsonObjectWriter {
+public:
+    JsonObjectWriter() = delete;
+    explicit JsonObjectWriter(std::ostream& out, JsonLayout layout = {}, OutputFormat format = OutputFormat::Json, size_t member_count = 0);
+
+    JsonObjectWriter(const JsonObjectWriter&) = delete;
+    auto operator=(const JsonObjectWriter&) = delete;
+
+    void Write(std::string_view key, const nlohmann::json& value);
+
+    // closes the object, must be called once after the last member
+    void Finish();
+
+    size_t GetMemberCount() const { return mMemberCount; }
+
+private:
+    void WriteValue(const nlohmann::json& value, size_t depth);
+    void WriteInline(const nlohmann::json& value);
+    void WriteIndent(size_t depth);
+
+    std::ostream& mOut;
+    JsonLayout mLayout;
+    OutputFormat mFormat;
+    std::string mIndent;
+    std::vector<std::string_view> mPath{};
+    size_t mExpectedMemberCount = 0;
+    size_t mMemberCount = 0;
+};
\ No newline at end of file
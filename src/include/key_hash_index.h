@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.h"
+
+#include <vector>
+
+// open addressing hash table over the rows of a shading model's key table, maps a full key to the index of its program
+// the table only stores hashes and program indices, rows are compared against the key table itself so it must outlive the index
+// read-only after Build, so it can be shared between threads
+class KeyHashIndex {
+public:
+    KeyHashIndex() = default;
+
+    void Build(const u32* key_table, u32 row_count, u32 row_width);
+
+    // index of the first program whose key equals the given key, or -1 if there is none
+    s32 Find(const u32* key) const;
+
+    bool IsBuilt() const { return !mSlots.empty(); }
+    u32 GetRowCount() const { return mRowCount; }
+    size_t GetCapacity() const { return mSlots.size(); }
+
+    static u64 HashKey(const u32* key, u32 width);
+
+private:
+    struct Slot {
+        u32 tag;
+        s32 index;
+    };
+
+    static constexpr s32 cEmptySlot = -1;
+
+    bool RowEquals(s32 index, const u32* key) const;
+
+    std::vector<Slot> mSlots{};
+    const u32* mKeyTable = nullptr;
+    u32 mRowCount = 0;
+    u32 mRowWidth = 0;
+    u32 mMask = 0;
+};
\ No newline at end of file
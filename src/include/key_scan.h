@@ -0,0 +1,76 @@
+#pragma once
+
+#include "types.h"
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+// vectorized scans over a shading model's key table, which is row-major with row_width u32 words per program
+namespace key_scan {
+
+enum class Backend {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// a row passes a clause if (row[word] & mask) equals one of the values, values are already shifted into place
+struct Clause {
+    u32 word;
+    u32 mask;
+    std::vector<u32> values;
+    // estimated fraction of rows that pass, negative if unknown (then it's estimated from the mask)
+    f32 selectivity = -1.0f;
+};
+
+// a single test on one key word, clauses are compiled into these
+struct Op {
+    enum class Kind : u8 {
+        // (row[word] & mask) == expected
+        Equal,
+        // bit ((row[word] & mask) >> shift) of allowed is set, the field is narrower than 64 values
+        Set,
+        // same as Set with the allowed bits in Program::wide_sets starting at wide_offset, expected holds the number of bits
+        WideSet,
+    };
+
+    Kind kind;
+    u32 word;
+    u32 mask;
+    u32 expected;
+    u32 shift;
+    u32 wide_offset;
+    u64 allowed;
+    f32 selectivity;
+};
+
+// a whole constraint set compiled to ops, ordered so the ops expected to reject the most rows run first
+struct Program {
+    std::vector<Op> ops{};
+    std::vector<u64> wide_sets{};
+    // some clause can't be satisfied (e.g. no allowed values or conflicting values for the same bits)
+    bool never_matches = false;
+};
+
+// best backend supported by the cpu we're running on, checked once
+Backend GetBestBackend();
+std::string_view GetBackendName(Backend backend);
+bool IsSupported(Backend backend);
+
+// single valued clauses on the same word are merged into one Equal, multi-valued ones become a Set lookup
+// clauses that allow every possible value are dropped
+Program Compile(std::span<const Clause> clauses);
+
+// rows passing the whole program as a bitset (bit i of word i / 64), an empty program matches every row
+void Run(const Program& program, const u32* key_table, u32 row_count, u32 row_width, std::vector<u64>& out_matches,
+         Backend backend = GetBestBackend());
+
+// compiles and runs in one go
+void Scan(const u32* key_table, u32 row_count, u32 row_width, std::span<const Clause> clauses, std::vector<u64>& out_matches,
+          Backend backend = GetBestBackend());
+
+// index of the first row equal to key, or -1 if there is none
+s32 FindExact(const u32* key_table, u32 row_count, u32 row_width, const u32* key, Backend backend = GetBestBackend());
+
+} // namespace key_scan
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "bfsha.h"
+
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// transposed view of a shading model's key table: one column per option holding each program's choice index
+// the key table packs several options into each u32 word row by row, which is the wrong way around for anything that filters or
+// aggregates over a single option, columns are decoded individually the first time they're requested and can be read by any thread
+// options are numbered static first, then dynamic, same as OptionBitmapIndex
+class KeyTableColumns {
+public:
+    // choices are stored in a byte unless the option has 256 or more of them, a key word value that isn't one of the option's choices
+    // reads back as the choice count
+    class Column {
+    public:
+        bool IsWide() const { return !mWide.empty(); }
+        std::span<const u8> GetNarrow() const { return mNarrow; }
+        std::span<const u16> GetWide() const { return mWide; }
+
+        u32 operator[](size_t row) const { return IsWide() ? mWide[row] : mNarrow[row]; }
+
+        // number of programs using each choice of the option
+        std::span<const u32> GetHistogram() const { return mHistogram; }
+
+        // calls func with whichever span holds the data, so loops over the column get a fixed element type
+        template <typename Func>
+        void Visit(Func&& func) const {
+            if (IsWide()) {
+                func(GetWide());
+            } else {
+                func(GetNarrow());
+            }
+        }
+
+    private:
+        friend class KeyTableColumns;
+
+        std::vector<u8> mNarrow{};
+        std::vector<u16> mWide{};
+        std::vector<u32> mHistogram{};
+    };
+
+    KeyTableColumns() = default;
+
+    KeyTableColumns(const KeyTableColumns&) = delete;
+    auto operator=(const KeyTableColumns&) = delete;
+
+    // doesn't decode anything yet
+    void Initialize(const g3d2::ResShadingModel* model);
+
+    u32 GetOptionCount() const { return mOptionCount; }
+    u32 GetStaticOptionCount() const { return mModel->static_option_count; }
+    u32 GetRowCount() const { return mModel->shader_program_count; }
+
+    u32 GetStaticSlot(u32 option_index) const { return option_index; }
+    u32 GetDynamicSlot(u32 option_index) const { return mModel->static_option_count + option_index; }
+
+    const g3d2::ResShaderOption* GetOption(u32 option_slot) const {
+        return option_slot < mModel->static_option_count ? mModel->static_option_array + option_slot
+                                                         : mModel->dynamic_option_array + (option_slot - mModel->static_option_count);
+    }
+
+    const Column& Get(u32 option_slot) const;
+
+private:
+    struct ColumnData {
+        std::once_flag decoded;
+        Column column;
+    };
+
+    void Decode(u32 option_slot, Column& column) const;
+
+    const g3d2::ResShadingModel* mModel = nullptr;
+    std::unique_ptr<ColumnData[]> mColumns{};
+    u32 mOptionCount = 0;
+};
\ No newline at end of file
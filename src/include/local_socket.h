@@ -0,0 +1,61 @@
+#pragma once
+
+#include "types.h"
+
+#include <string>
+#include <string_view>
+
+// unix domain stream socket carrying newline-delimited messages, only supported on posix systems
+class LocalSocket {
+public:
+    LocalSocket() = default;
+    ~LocalSocket() { Close(); }
+
+    LocalSocket(const LocalSocket&) = delete;
+    auto operator=(const LocalSocket&) = delete;
+
+    LocalSocket(LocalSocket&& other) noexcept { *this = std::move(other); }
+    LocalSocket& operator=(LocalSocket&& other) noexcept;
+
+    static bool IsSupported();
+
+    // a stale socket left behind at path by a previous run is removed first, the socket is removed again on Close
+    // fails with errno set to EEXIST if something other than a socket exists at path
+    bool Listen(const std::string& path, int backlog = 16);
+
+    // reads stdin with ReadLine so a blocked read can be woken up by Shutdown, stdin itself is not closed
+    // invalid if sockets aren't supported
+    static LocalSocket OpenStandardInput();
+
+    // blocks until a client connects, the returned socket is invalid once the listener has been shut down
+    LocalSocket Accept();
+
+    // reads up to the next newline (which is not included), returns false once the peer disconnects or the socket is shut down
+    bool ReadLine(std::string& line);
+
+    // writes all of data, returns false if the peer went away
+    bool Write(std::string_view data);
+
+    // wakes up any thread blocked in Accept or ReadLine on this socket and makes later calls return right away, safe to call from
+    // another thread; only reading stops so a response that is still being written goes through
+    void Shutdown();
+
+    void Close();
+
+    bool IsValid() const { return mHandle >= 0; }
+
+private:
+    explicit LocalSocket(int handle) : mHandle(handle) {}
+
+    bool CreateWakePipe();
+
+    // false if woken up by Shutdown
+    bool WaitReadable() const;
+
+    std::string mPath{};
+    std::string mBuffer{};
+    size_t mBufferOffset = 0;
+    int mHandle = -1;
+    int mWakeHandles[2] = { -1, -1 }; // read end, write end
+    bool mOwnsHandle = true;
+};
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "types.h"
+
+#include <span>
+#include <string>
+
+// memory-mapped view of a file, copy-on-write mappings can be relocated in place without touching the file on disk
+class MappedFile {
+public:
+    enum class Access {
+        ReadOnly,
+        CopyOnWrite,
+    };
+
+    enum class Advice {
+        Normal,
+        Sequential, // read once front to back
+        Random,     // only small parts get touched, don't bother reading ahead
+        WillNeed,   // start paging the whole file in asynchronously
+    };
+
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    auto operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool Open(const std::string& path, Access access = Access::CopyOnWrite, Advice advice = Advice::Normal);
+    void Close();
+
+    void Advise(Advice advice) const;
+
+    u8* GetData() const { return mData; }
+    size_t GetSize() const { return mSize; }
+    bool IsEmpty() const { return mData == nullptr; }
+
+    std::span<u8> GetSpan() const { return { mData, mSize }; }
+
+private:
+    u8* mData = nullptr;
+    size_t mSize = 0;
+#ifdef _WIN32
+    void* mMappingHandle = nullptr;
+#endif
+};
\ No newline at end of file
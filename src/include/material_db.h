@@ -0,0 +1,202 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "types.h"
+
+#include <nlohmann/json.hpp>
+
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace material_db {
+
+// "MTMATDB\0"
+constexpr u64 cSignature = 0x00424454414d544d;
+constexpr u32 cVersion = 1;
+
+constexpr u32 cInvalidId = 0xffffffffu;
+
+// every offset is relative to the start of the file and every section is 8 byte aligned, so a mapped file is used as is
+struct Section {
+    u32 offset;
+    u32 count;
+};
+
+// elements [first, first + count) of one of the sections
+struct Range {
+    u32 first;
+    u32 count;
+};
+
+// strings are referenced by id, string i is the bytes between string_offsets[i] and string_offsets[i + 1] of string_data
+struct Header {
+    u64 signature;
+    u32 version;
+    u32 file_size;
+    Section string_offsets;      // u32, one more than there are strings
+    Section string_data;         // char
+    Section string_hash;         // u32 string ids, open addressing on HashString with cInvalidId in empty slots, the count is a power of two
+    Section files;               // File, sorted by name
+    Section models;              // Model, sorted by name within each file
+    Section materials;           // Material, sorted by name within each model
+    Section values;              // Value, static options and render info
+    Section names;               // u32 string ids, samplers and textures
+    Section variants;            // Variant
+    Section material_name_index; // IndexEntry, material name -> material
+    Section program_index;       // IndexEntry, program index -> material selecting it for at least one skin count
+};
+static_assert(sizeof(Header) == 0x68);
+
+struct File {
+    u32 name;
+    Range models;
+    Range materials;
+};
+
+struct Model {
+    u32 name;
+    u32 file;
+    Range materials;
+};
+
+struct Material {
+    u32 name;
+    u32 model;
+    u32 file;
+    Range static_options; // values
+    Range render_info;    // values
+    Range samplers;       // names
+    Range textures;       // names
+    Range variants;
+};
+
+enum class ValueType : u32 {
+    Bool,
+    Int,    // s32
+    Float,  // f32
+    String, // string id
+};
+
+struct Value {
+    u32 key;
+    ValueType type;
+    u32 data;
+};
+
+struct Variant {
+    u32 skin_count;
+    s32 program_index;
+};
+
+// sorted by key, then by material
+struct IndexEntry {
+    u32 key;
+    u32 material;
+};
+
+// FNV-1a, stable across builds unlike std::hash
+u64 HashString(std::string_view str);
+
+} // namespace material_db
+
+// collects dump output one file at a time and lays it out as a material database
+class MaterialDbBuilder {
+public:
+    MaterialDbBuilder() = default;
+
+    // info is one file's dump output (model -> material -> info), files have to be added in name order
+    void AddFile(std::string_view filename, const nlohmann::json& info);
+
+    std::vector<u8> Build() const;
+
+    size_t GetMaterialCount() const { return mMaterials.size(); }
+
+private:
+    u32 AddString(std::string_view str);
+    material_db::Range AddValues(const nlohmann::json& values);
+    material_db::Range AddNames(const nlohmann::json& names);
+
+    std::string mStringData{};
+    std::vector<u32> mStringOffsets{ 0 };
+    std::unordered_map<std::string, u32> mStringIds{};
+    std::vector<material_db::File> mFiles{};
+    std::vector<material_db::Model> mModels{};
+    std::vector<material_db::Material> mMaterials{};
+    std::vector<material_db::Value> mValues{};
+    std::vector<u32> mNames{};
+    std::vector<material_db::Variant> mVariants{};
+};
+
+// read-only access to a material database, lookups go straight to the mapped file without parsing or copying anything
+// sections and the file/model/material indices are checked when the file is opened (Open fails on a corrupt file), ranges and string ids
+// are checked when they are accessed and throw std::runtime_error
+class MaterialDb {
+public:
+    MaterialDb() = default;
+
+    MaterialDb(const MaterialDb&) = delete;
+    auto operator=(const MaterialDb&) = delete;
+
+    bool Open(const std::string& path);
+
+    bool IsOpen() const { return mHeader != nullptr; }
+
+    std::span<const material_db::File> GetFiles() const { return GetSection<material_db::File>(mHeader->files); }
+    std::span<const material_db::Model> GetModels() const { return GetSection<material_db::Model>(mHeader->models); }
+    std::span<const material_db::Material> GetMaterials() const { return GetSection<material_db::Material>(mHeader->materials); }
+
+    std::span<const material_db::Model> GetModels(const material_db::File& file) const { return GetRange<material_db::Model>(mHeader->models, file.models); }
+    std::span<const material_db::Material> GetMaterials(const material_db::File& file) const { return GetRange<material_db::Material>(mHeader->materials, file.materials); }
+    std::span<const material_db::Material> GetMaterials(const material_db::Model& model) const { return GetRange<material_db::Material>(mHeader->materials, model.materials); }
+
+    std::span<const material_db::Value> GetStaticOptions(const material_db::Material& material) const { return GetRange<material_db::Value>(mHeader->values, material.static_options); }
+    std::span<const material_db::Value> GetRenderInfo(const material_db::Material& material) const { return GetRange<material_db::Value>(mHeader->values, material.render_info); }
+    std::span<const u32> GetSamplers(const material_db::Material& material) const { return GetRange<u32>(mHeader->names, material.samplers); }
+    std::span<const u32> GetTextures(const material_db::Material& material) const { return GetRange<u32>(mHeader->names, material.textures); }
+    std::span<const material_db::Variant> GetVariants(const material_db::Material& material) const { return GetRange<material_db::Variant>(mHeader->variants, material.variants); }
+
+    std::string_view GetString(u32 id) const;
+
+    // cInvalidId if the string doesn't appear anywhere in the database
+    u32 FindString(std::string_view str) const;
+
+    // nullptr if there is no such file/model/material
+    const material_db::File* FindFile(std::string_view name) const;
+    const material_db::Model* FindModel(const material_db::File& file, std::string_view name) const;
+    const material_db::Material* FindMaterial(const material_db::Model& model, std::string_view name) const;
+
+    // every material with the given name across all files
+    std::span<const material_db::IndexEntry> FindMaterialsByName(std::string_view name) const;
+
+    // every material that selects the given program for at least one skin count
+    std::span<const material_db::IndexEntry> FindMaterialsByProgram(s32 program_index) const;
+
+    u32 GetIndex(const material_db::Material& material) const { return static_cast<u32>(&material - GetMaterials().data()); }
+
+    // the material's entry as dump writes it
+    nlohmann::json GetInfo(const material_db::Material& material) const;
+    nlohmann::json GetValue(const material_db::Value& value) const;
+
+private:
+    template <typename T>
+    std::span<const T> GetSection(const material_db::Section& section) const {
+        return { reinterpret_cast<const T*>(mFile.GetData() + section.offset), section.count };
+    }
+
+    template <typename T>
+    std::span<const T> GetRange(const material_db::Section& section, const material_db::Range& range) const {
+        if (static_cast<u64>(range.first) + range.count > section.count)
+            throw std::runtime_error("Corrupt material database: range out of bounds");
+
+        return GetSection<T>(section).subspan(range.first, range.count);
+    }
+
+    std::span<const material_db::IndexEntry> FindIndexEntries(const material_db::Section& section, u32 key) const;
+
+    MappedFile mFile{};
+    const material_db::Header* mHeader = nullptr;
+};
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "key_table_columns.h"
+
+#include <span>
+#include <vector>
+
+// one bitset over a shading model's programs for every choice of every option, bit i is set if program i uses that choice
+// options are numbered static first, then dynamic, same as KeyTableColumns
+// read-only after Build, so it can be shared between threads
+class OptionBitmapIndex {
+public:
+    // a program passes a term if its choice for the option is any of the given choices
+    struct Term {
+        u32 option_slot;
+        std::span<const u32> choices;
+    };
+
+    OptionBitmapIndex() = default;
+
+    // decodes every column of the model
+    void Build(const KeyTableColumns& columns);
+
+    u32 GetRowCount() const { return mRowCount; }
+    size_t GetWordCount() const { return mWordCount; }
+    size_t GetByteSize() const { return mBits.size() * sizeof(u64); }
+
+    u32 GetStaticSlot(u32 option_index) const { return option_index; }
+    u32 GetDynamicSlot(u32 option_index) const { return mStaticOptionCount + option_index; }
+
+    u32 GetChoiceCount(u32 option_slot) const { return mOptionOffsets[option_slot + 1] - mOptionOffsets[option_slot]; }
+
+    std::span<const u64> Get(u32 option_slot, u32 choice) const {
+        return { mBits.data() + (static_cast<size_t>(mOptionOffsets[option_slot]) + choice) * mWordCount, mWordCount };
+    }
+
+    // OR across each term's choices, AND across terms, no terms selects every program
+    void Select(std::span<const Term> terms, std::vector<u64>& out_matches) const;
+
+    static size_t Count(std::span<const u64> bits);
+
+private:
+    std::vector<u64> mBits{};
+    // first bitmap of each option slot, with one extra entry at the end
+    std::vector<u32> mOptionOffsets{};
+    size_t mWordCount = 0;
+    u32 mRowCount = 0;
+    u32 mStaticOptionCount = 0;
+};
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "bfsha.h"
+#include "symbol_table.h"
+
+#include <string_view>
+#include <vector>
+
+// flat hash tables for a shading model's option names and choice names, resolving a material's options to (option, choice) pairs
+// this way takes a couple of probes instead of a walk down each ResDic's trie and never allocates
+// names are interned when the tables are built, so a lookup by symbol is nothing but integer compares; read-only after Build
+// options are numbered static first, then dynamic, same as KeyTableColumns
+class OptionLookup {
+public:
+    OptionLookup() = default;
+
+    // slots of the static and the dynamic option with the same name, -1 for either the model doesn't have
+    struct OptionSlots {
+        s32 static_slot = -1;
+        s32 dynamic_slot = -1;
+    };
+
+    void Build(const g3d2::ResShadingModel* model);
+
+    OptionSlots FindOptions(Symbol name) const;
+    OptionSlots FindOptions(std::string_view name) const { return FindOptions(SymbolTable::Find(name)); }
+
+    // index of the choice of the option in slot with the given name or -1 if the option has no such choice
+    s32 FindChoice(u32 slot, Symbol value) const;
+    s32 FindChoice(u32 slot, std::string_view value) const { return FindChoice(slot, SymbolTable::Find(value)); }
+
+    const g3d2::ResShaderOption* GetOption(u32 slot) const {
+        return IsDynamic(slot) ? mModel->dynamic_option_array + (slot - mModel->static_option_count) : mModel->static_option_array + slot;
+    }
+
+    bool IsDynamic(u32 slot) const { return slot >= mModel->static_option_count; }
+
+    bool IsBuilt() const { return mModel != nullptr; }
+    u32 GetOptionCount() const { return mOptionCount; }
+    size_t GetByteSize() const { return mOptionSlots.size() * sizeof(OptionSlot) + mChoiceSlots.size() * sizeof(ChoiceSlot); }
+
+    static u64 HashSymbol(Symbol symbol, u32 seed = 0);
+
+private:
+    struct OptionSlot {
+        Symbol name;
+        OptionSlots slots; // both cEmptySlot if the entry is empty
+    };
+
+    // every option's choices share one table, the option's slot is part of the hash and the entry
+    struct ChoiceSlot {
+        Symbol name;
+        u32 option;
+        s32 choice;
+    };
+
+    static constexpr s32 cEmptySlot = -1;
+
+    std::vector<OptionSlot> mOptionSlots{};
+    std::vector<ChoiceSlot> mChoiceSlots{};
+    const g3d2::ResShadingModel* mModel = nullptr;
+    u32 mOptionCount = 0;
+    u32 mOptionMask = 0;
+    u32 mChoiceMask = 0;
+};
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "bounded_queue.h"
+#include "thread_pool.h"
+#include "types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <semaphore>
+#include <utility>
+#include <vector>
+
+// runs items [0, count) through read -> decompress -> parse on a thread pool and hands every result to the writer in item order on
+// the calling thread, memory use is capped by the queue depth and the number of items in flight rather than the item count
+// if a stage or the writer throws, every queue is closed and every worker joined before the first exception is rethrown
+template <typename Data, typename Result>
+class OrderedPipeline {
+public:
+    using ReadFunc = std::function<Data(size_t index)>;
+    using DecompressFunc = std::function<void(size_t index, Data& data)>;
+    using ParseFunc = std::function<Result(size_t index, Data& data)>;
+    using WriteFunc = std::function<void(size_t index, Result& result)>;
+    using SizeFunc = std::function<size_t(size_t index)>;
+
+    OrderedPipeline() = delete;
+    OrderedPipeline(ReadFunc read, DecompressFunc decompress, ParseFunc parse, WriteFunc write)
+        : mRead(std::move(read)), mDecompress(std::move(decompress)), mParse(std::move(parse)), mWrite(std::move(write)) {}
+
+    // items that have been read but not written yet, each one holds a ticket until its result has been written so no more than this
+    // many results ever wait on an earlier, slower item
+    static size_t GetMaxInFlight(u32 job_count) { return GetQueueDepth(job_count) * 4; }
+
+    // with get_size, items are read largest first within each window of GetMaxInFlight items (in output order), so a big item starts
+    // early instead of being the tail of the run; the window keeps the first unwritten item from ever waiting on a ticket
+    void Run(size_t count, u32 job_count, const SizeFunc& get_size = {}) const {
+        // split the workers between decompression and parsing
+        const u32 decompress_count = std::max(job_count / 2, 1u);
+        const u32 parse_count = std::max(job_count - decompress_count, 1u);
+        const size_t queue_depth = GetQueueDepth(job_count);
+
+        const size_t max_in_flight = GetMaxInFlight(job_count);
+        std::counting_semaphore<> tickets(static_cast<std::ptrdiff_t>(max_in_flight));
+
+        std::vector<size_t> read_order(count);
+        for (size_t i = 0; i < count; ++i)
+            read_order[i] = i;
+        if (get_size) {
+            for (size_t begin = 0; begin < count; begin += max_in_flight) {
+                const auto end = read_order.begin() + static_cast<std::ptrdiff_t>(std::min(begin + max_in_flight, count));
+                std::stable_sort(read_order.begin() + static_cast<std::ptrdiff_t>(begin), end,
+                                 [&get_size](size_t lhs, size_t rhs) { return get_size(lhs) > get_size(rhs); });
+            }
+        }
+
+        BoundedQueue<std::pair<size_t, Data>> read_queue(queue_depth);
+        BoundedQueue<std::pair<size_t, Data>> decompress_queue(queue_depth);
+        BoundedQueue<std::pair<size_t, Result>> result_queue(queue_depth);
+
+        const auto close_all = [&] {
+            read_queue.Close();
+            decompress_queue.Close();
+            result_queue.Close();
+        };
+
+        ThreadPool pool(1 + decompress_count + parse_count);
+        std::atomic<u32> decompress_remaining = decompress_count;
+        std::atomic<u32> parse_remaining = parse_count;
+
+        pool.Submit([&](u32) {
+            try {
+                for (const size_t index : read_order) {
+                    tickets.acquire();
+                    if (!read_queue.Push({ index, mRead(index) }))
+                        break;
+                }
+            } catch (...) {
+                close_all();
+                throw;
+            }
+            read_queue.Close();
+        });
+
+        for (u32 i = 0; i < decompress_count; ++i) {
+            pool.Submit([&](u32) {
+                try {
+                    while (auto item = read_queue.Pop()) {
+                        mDecompress(item->first, item->second);
+                        if (!decompress_queue.Push(std::move(*item)))
+                            break;
+                    }
+                } catch (...) {
+                    close_all();
+                    throw;
+                }
+                if (--decompress_remaining == 0)
+                    decompress_queue.Close();
+            });
+        }
+
+        for (u32 i = 0; i < parse_count; ++i) {
+            pool.Submit([&](u32) {
+                try {
+                    while (auto item = decompress_queue.Pop()) {
+                        if (!result_queue.Push({ item->first, mParse(item->first, item->second) }))
+                            break;
+                    }
+                } catch (...) {
+                    close_all();
+                    throw;
+                }
+                if (--parse_remaining == 0)
+                    result_queue.Close();
+            });
+        }
+
+        // results arrive in completion order, each one is written as soon as every item before it has been
+        std::vector<std::optional<Result>> pending(count);
+        size_t next_index = 0;
+        try {
+            while (auto result = result_queue.Pop()) {
+                pending[result->first] = std::move(result->second);
+                for (; next_index < count && pending[next_index].has_value(); ++next_index) {
+                    mWrite(next_index, *pending[next_index]);
+                    pending[next_index].reset();
+                    tickets.release();
+                }
+            }
+        } catch (...) {
+            // the workers may be blocked pushing into a full queue or the reader waiting on a ticket that would never be returned,
+            // they have to be woken before the pool can be joined; the writer's exception takes precedence over theirs
+            close_all();
+            tickets.release(static_cast<std::ptrdiff_t>(max_in_flight));
+            try {
+                pool.Wait();
+            } catch (...) {
+            }
+            throw;
+        }
+
+        // the reader may still be waiting on a ticket if a stage failed and closed the queues
+        tickets.release();
+        pool.Wait();
+    }
+
+private:
+    static size_t GetQueueDepth(u32 job_count) { return std::max(job_count, 2u); }
+
+    ReadFunc mRead;
+    DecompressFunc mDecompress;
+    ParseFunc mParse;
+    WriteFunc mWrite;
+};
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "bfres.h"
+#include "bfsha.h"
+
+#include <concepts>
+#include <string_view>
+#include <type_traits>
+
+// read-only view of a structure inside an unrelocated file
+// pointer fields of unrelocated files hold offsets from the start of the file (or the start of the embedded file they belong to),
+// so instead of relocating the file in place, views resolve those offsets whenever a pointer field is followed
+// this means files can be mapped read-only and shared between threads and processes without being copied
+template <typename T>
+class ResView {
+public:
+    ResView() = default;
+    ResView(const u8* base, const T* data) : mBase(base), mData(data) {}
+
+    // view of the root structure of a file
+    explicit ResView(const u8* base) : mBase(base), mData(reinterpret_cast<const T*>(base)) {}
+
+    static ResView FromOffset(const u8* base, u64 offset) {
+        if (offset == 0)
+            return {};
+        return { base, reinterpret_cast<const T*>(base + offset) };
+    }
+
+    bool IsValid() const { return mData != nullptr; }
+    explicit operator bool() const { return IsValid(); }
+
+    // only non-pointer fields may be read directly
+    const T* operator->() const { return mData; }
+    const T& operator*() const { return *mData; }
+
+    const T* GetData() const { return mData; }
+    const u8* GetBase() const { return mBase; }
+
+    // element of an array starting at this view
+    ResView operator[](size_t index) const { return { mBase, mData + index }; }
+
+    // embedded files (e.g. the BNSH inside a bfsha) resolve their offsets relative to their own start
+    template <typename U>
+    ResView Rebase(const ResView<U>& file) const { return { reinterpret_cast<const u8*>(file.GetData()), mData }; }
+
+    template <typename U, typename Class>
+        requires std::derived_from<T, Class>
+    ResView<U> Get(U* Class::* member) const {
+        return ResView<U>::FromOffset(mBase, ToOffset(mData->*member));
+    }
+
+    // pointer stored in a fixed size array field
+    template <typename U, typename Class, size_t N>
+        requires std::derived_from<T, Class>
+    ResView<U> Get(U* (Class::* member)[N], size_t index) const {
+        return ResView<U>::FromOffset(mBase, ToOffset((mData->*member)[index]));
+    }
+
+    // dereferences a view of a pointer (e.g. an element of a BinString** array)
+    ResView<std::remove_pointer_t<T>> Deref() const requires std::is_pointer_v<T> {
+        return ResView<std::remove_pointer_t<T>>::FromOffset(mBase, ToOffset(*mData));
+    }
+
+    template <typename Class>
+        requires std::derived_from<T, Class>
+    std::string_view GetString(BinString* Class::* member) const {
+        const auto string = Get(member);
+        return string ? string->Get() : std::string_view{};
+    }
+
+    std::string_view GetString() const requires std::same_as<T, BinString> {
+        return mData->Get();
+    }
+
+    std::string_view GetString() const requires std::same_as<T, BinString*> {
+        const auto string = Deref();
+        return string ? string->Get() : std::string_view{};
+    }
+
+    // same as ResDic::FindIndex
+    int FindIndex(const std::string_view& key) const requires std::same_as<T, ResDic> {
+        const int index = mData->FindCandidateIndex(key);
+        return GetKey(index) == key ? index : -1;
+    }
+
+    std::string_view GetKey(int index) const requires std::same_as<T, ResDic> {
+        return ResView<ResDic::Entry>(mBase, &mData->entries[index + 1]).GetString(&ResDic::Entry::key);
+    }
+
+private:
+    template <typename U>
+    static u64 ToOffset(U* ptr) { return static_cast<u64>(reinterpret_cast<uintptr_t>(ptr)); }
+
+    const u8* mBase = nullptr;
+    const T* mData = nullptr;
+};
+
+using ResFileView = ResView<ResFile>;
+using ResModelView = ResView<ResModel>;
+using ResMaterialView = ResView<ResMaterial>;
+using ResDicView = ResView<ResDic>;
+using ResShaderFileView = ResView<g3d2::ResShaderFile>;
+using ResShaderArchiveView = ResView<g3d2::ResShaderArchive>;
+using ResShadingModelView = ResView<g3d2::ResShadingModel>;
+using ResShaderOptionView = ResView<g3d2::ResShaderOption>;
\ No newline at end of file
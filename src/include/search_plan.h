@@ -0,0 +1,58 @@
+#pragma once
+
+#include "key_scan.h"
+#include "shader_archive.h"
+
+#include <ostream>
+#include <span>
+#include <vector>
+
+// decides how to evaluate a set of search constraints on one shading model
+// the selectivity of each constraint comes from the choice histograms of the key table columns, so a constraint no program passes ends
+// the search before anything is scanned, constraints every program passes are dropped and the rest run most selective first
+class SearchPlan {
+public:
+    // a program passes if its choice for the option is one of the given choices
+    struct Term {
+        const g3d2::ResShaderOption* option;
+        bool is_dynamic;
+        std::vector<u32> choices;
+    };
+
+    enum class Strategy {
+        // some term can't be satisfied
+        Empty,
+        // compiled key_scan program over the key table
+        Scan,
+        // OptionBitmapIndex, worth building for large models
+        Bitmaps,
+    };
+
+    // the terms are referenced, not copied, so they have to outlive the plan
+    SearchPlan(const ShaderArchive& archive, const g3d2::ResShadingModel* model, std::span<const Term> terms);
+
+    Strategy GetStrategy() const { return mStrategy; }
+
+    void Execute(std::vector<u64>& out_matches) const;
+
+    // prints the plan along with how many programs each step actually eliminated
+    // the steps are run one at a time to get the counts, so this is slower than Execute
+    void Explain(std::ostream& stream) const;
+
+private:
+    struct Step {
+        const Term* term;
+        u32 option_slot;
+        // programs passing this term on its own, according to the histogram
+        u32 passing_count;
+    };
+
+    f64 GetSelectivity(const Step& step) const;
+    void Describe(std::ostream& stream, const Step& step) const;
+
+    const ShaderArchive& mArchive;
+    const g3d2::ResShadingModel* mModel;
+    std::vector<Step> mSteps{};
+    std::vector<Step> mDroppedSteps{};
+    Strategy mStrategy = Strategy::Scan;
+};
\ No newline at end of file
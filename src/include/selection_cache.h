@@ -0,0 +1,59 @@
+#pragma once
+
+#include "shader.h"
+#include "shader_archive.h"
+#include "symbol_table.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// memoizes ShaderSelector::SearchVariants across materials, most materials in the romfs share their option set with many others
+// keyed by the selector's archive, model and (already sorted, so canonical) interned options, safe to use from any number of threads
+class SelectionCache {
+public:
+    using Result = std::vector<ShaderSelector::VariantMatch>;
+
+    SelectionCache() = delete;
+    SelectionCache(const std::string_view option_name, std::span<const std::string> values) : mOptionName(option_name), mValues(values) {}
+
+    SelectionCache(const SelectionCache&) = delete;
+    auto operator=(const SelectionCache&) = delete;
+
+    // the result of selector.SearchVariants(archive, option_name, values) for the selector's options, only searching on a miss
+    // the reference stays valid for the lifetime of the cache
+    const Result& SearchVariants(ShaderSelector& selector, const ShaderArchive& archive);
+
+    u64 GetHitCount() const { return mHitCount; }
+    u64 GetMissCount() const { return mMissCount; }
+    size_t GetEntryCount() const;
+
+private:
+    struct Entry {
+        Symbol archive_name;
+        Symbol model_name;
+        std::vector<SymbolMap::Entry> options;
+        Result result;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_multimap<u64, Entry> entries;
+    };
+
+    static constexpr size_t cShardCount = 16;
+
+    static u64 HashOptions(const ShaderSelector& selector);
+    static bool Matches(const Entry& entry, const ShaderSelector& selector);
+
+    std::array<Shard, cShardCount> mShards{};
+    std::string_view mOptionName;
+    std::span<const std::string> mValues;
+    std::atomic<u64> mHitCount = 0;
+    std::atomic<u64> mMissCount = 0;
+};
\ No newline at end of file
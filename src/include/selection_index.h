@@ -0,0 +1,36 @@
+#pragma once
+
+#include "bfsha.h"
+#include "res_view.h"
+
+#include <span>
+#include <vector>
+
+namespace selection_index {
+
+// "MTSELIDX"
+constexpr u64 cSignature = 0x5844494c4553544d;
+constexpr int cVersionMajor = 1;
+constexpr int cVersionMinor = 1;
+constexpr int cVersionMicro = 0;
+
+// a stripped down bfsha containing only what shader selection needs: the option tables, choice dictionaries and key tables
+// it uses the same layout as a bfsha so it can be loaded with g3d2::ResShaderFile::ResCast and used in place of the full archive,
+// programs and shader binaries are left out entirely (program_array and shader are null)
+struct ResSelectionIndexFile : public g3d2::ResShaderFile {
+    u64 source_fingerprint;
+    u64 source_size;
+
+    bool IsValid() const {
+        return BinaryFileHeader::IsValid(cSignature, cVersionMajor, cVersionMinor, cVersionMicro);
+    }
+};
+static_assert(sizeof(ResSelectionIndexFile) == 0x48);
+
+// fingerprint of the unrelocated archive, hashes the whole file since an edit anywhere (a key table, a choice) can change selection
+u64 ComputeFingerprint(std::span<const u8> data);
+
+// builds the index from an unrelocated archive
+std::vector<u8> Build(const ResShaderFileView& file, u64 source_fingerprint, u64 source_size);
+
+} // namespace selection_index
\ No newline at end of file
@@ -3,30 +3,48 @@
 #include "types.h"
 #include "bfres.h"
 #include "bfsha.h"
+#include "shader_archive.h"
+#include "symbol_table.h"
 
 #include <nlohmann/json.hpp>
 
+#include <span>
 #include <string_view>
-#include <unordered_map>
 #include <vector>
 
 using json = nlohmann::json;
 
 class ShaderSelector {
 public:
-    using OptionMap = std::unordered_map<std::string, std::string>;
+    // option names and values are interned, loading a material's options doesn't allocate unless it has an unusually large number of them
+    using OptionMap = SymbolMap;
 
     ShaderSelector() = default;
 
     void LoadOptions(const ResMaterial* material);
-    void LoadOptions(const json& options);
+    // only the options (and archive/model name) the archive knows are kept, see the definition
+    void LoadOptions(const json& options, const ShaderArchive& archive);
 
-    const g3d2::ResShaderProgram* Search(const g3d2::ResShaderFile* shader_file);
+    // returns the index of the matching program in the shading model or -1 if there is none
+    // only the option tables and key table are used, so this also works on a selection index
+    s32 Search(const ShaderArchive& archive);
+
+    struct VariantMatch {
+        u32 variant;
+        s32 program_index;
+    };
+
+    // searches for every value of one option at once (e.g. each gsys_weight skin count), the key is only built once and each variant
+    // just rewrites that option's bits before probing, values the option has no choice for fall back to its default like Search does
+    // only variants with a matching program are returned, in order
+    std::vector<VariantMatch> SearchVariants(const ShaderArchive& archive, const std::string_view option_name, std::span<const std::string> values);
 
     const OptionMap& GetOptions() const { return mOptions; }
+    Symbol GetArchiveName() const { return mArchiveName; }
+    Symbol GetModelName() const { return mModelName; }
 
-    void SetOption(const std::string& key, const std::string_view& value) {
-        mOptions[key] = value;
+    void SetOption(const std::string_view& key, const std::string_view& value) {
+        mOptions.Set(SymbolTable::Intern(key), SymbolTable::Intern(value));
     }
 
     static const std::array<std::string, 18> cNumberNames;
@@ -89,14 +107,14 @@ public:
     u32 GetDynamicKeyValue(const g3d2::ResShaderOption* option) const;
 
 private:
-    void WriteKeys(const g3d2::ResShadingModel* model);
+    void WriteKeys(const ShaderArchive& archive, const g3d2::ResShadingModel* model);
     void WriteDefaultKeys(const g3d2::ResShadingModel* model);
 
     void WriteStaticKey(const g3d2::ResShaderOption* option, u32 value);
     void WriteDynamicKey(const g3d2::ResShaderOption* option, u32 value);
 
-    std::string mArchiveName;
-    std::string mModelName;
+    Symbol mArchiveName = SymbolTable::cInvalidSymbol;
+    Symbol mModelName = SymbolTable::cInvalidSymbol;
     OptionMap mOptions{};
     std::vector<u32> mKeys{};
     u32 mStaticKeyCount = 0;
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "bfsha.h"
+#include "key_hash_index.h"
+#include "key_table_columns.h"
+#include "option_bitmap_index.h"
+#include "option_lookup.h"
+
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+// wraps a relocated bfsha and lazily sets up per shading model data the first time a model is actually used
+// all accessors are safe to call concurrently
+class ShaderArchive {
+public:
+    ShaderArchive() = default;
+
+    ShaderArchive(const ShaderArchive&) = delete;
+    auto operator=(const ShaderArchive&) = delete;
+
+    bool Initialize(g3d2::ResShaderFile* file);
+
+    bool IsInitialized() const { return mFile != nullptr; }
+
+    const g3d2::ResShaderFile* GetFile() const { return mFile; }
+    const g3d2::ResShaderArchive* GetArchive() const { return mFile->archive; }
+    std::string_view GetName() const { return mFile->archive->name->Get(); }
+
+    size_t GetModelCount() const { return mFile->archive->shading_model_count; }
+    const g3d2::ResShadingModel* GetModel(size_t index) const { return mFile->archive->shading_model_array + index; }
+    const g3d2::ResShadingModel* FindModel(const std::string_view name) const;
+
+    size_t GetModelIndex(const g3d2::ResShadingModel* model) const {
+        return static_cast<size_t>(model - mFile->archive->shading_model_array);
+    }
+
+    // the embedded BNSH is only relocated the first time it is requested
+    const ::gfx::ResShaderFile* GetShader(const g3d2::ResShadingModel* model) const;
+    const ::gfx::ResShaderVariation* GetVariation(const g3d2::ResShadingModel* model, size_t program_index) const;
+
+    // models with fewer programs than this are scanned rather than indexed, a block or two of rows is cheaper than hashing the key
+    static constexpr u32 cKeyIndexMinPrograms = 128;
+
+    // exact key -> program index lookup, built the first time the model is searched
+    const KeyHashIndex& GetKeyIndex(const g3d2::ResShadingModel* model) const;
+
+    // index of the program whose key equals the given one or -1, picks between scanning and the key index by model size
+    s32 FindProgram(const g3d2::ResShadingModel* model, const u32* key) const;
+
+    // per option choice columns, each is decoded the first time it's requested
+    const KeyTableColumns& GetColumns(const g3d2::ResShadingModel* model) const;
+
+    // below this a single scan of the key table is cheaper than building the bitmaps
+    static constexpr u32 cOptionBitmapMinPrograms = 1024;
+
+    // per (option, choice) program bitsets, built the first time they're requested
+    const OptionBitmapIndex& GetOptionBitmaps(const g3d2::ResShadingModel* model) const;
+
+    // option name and choice name tables, built the first time the model is searched
+    const OptionLookup& GetOptionLookup(const g3d2::ResShadingModel* model) const;
+
+private:
+    struct ModelData {
+        std::once_flag shader_relocated;
+        std::once_flag key_index_built;
+        KeyHashIndex key_index;
+        KeyTableColumns columns;
+        std::once_flag option_bitmaps_built;
+        OptionBitmapIndex option_bitmaps;
+        std::once_flag option_lookup_built;
+        OptionLookup option_lookup;
+    };
+
+    g3d2::ResShaderFile* mFile = nullptr;
+    std::unique_ptr<ModelData[]> mModelData{};
+};
\ No newline at end of file
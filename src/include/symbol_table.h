@@ -0,0 +1,106 @@
+#pragma once
+
+#include "types.h"
+
+#include <algorithm>
+#include <array>
+#include <string_view>
+#include <vector>
+
+using Symbol = u32;
+
+// process-wide string interner, equal strings always map to the same symbol so they can be compared and hashed as integers
+// interning a string that is already known doesn't allocate, all functions are safe to call concurrently
+class SymbolTable {
+public:
+    static constexpr Symbol cInvalidSymbol = 0xffffffffu;
+
+    static Symbol Intern(std::string_view str);
+
+    // doesn't add the string, cInvalidSymbol if it has never been interned
+    static Symbol Find(std::string_view str);
+
+    // the view stays valid for the lifetime of the process
+    static std::string_view GetString(Symbol symbol);
+
+    static size_t GetCount();
+};
+
+// symbol -> symbol map kept as a vector sorted by key, small maps (the usual case) live entirely inline
+class SymbolMap {
+public:
+    struct Entry {
+        Symbol key;
+        Symbol value;
+    };
+
+    static constexpr size_t cInlineCapacity = 64;
+
+    SymbolMap() = default;
+
+    // doesn't overwrite an existing value, returns false if the key was already present
+    bool Emplace(Symbol key, Symbol value) {
+        Entry* entry = LowerBound(key);
+        if (entry != end() && entry->key == key)
+            return false;
+
+        Insert(static_cast<size_t>(entry - begin()), { key, value });
+        return true;
+    }
+
+    void Set(Symbol key, Symbol value) {
+        Entry* entry = LowerBound(key);
+        if (entry != end() && entry->key == key) {
+            entry->value = value;
+            return;
+        }
+
+        Insert(static_cast<size_t>(entry - begin()), { key, value });
+    }
+
+    // cInvalidSymbol if the key isn't present
+    Symbol Find(Symbol key) const {
+        const Entry* entry = std::lower_bound(begin(), end(), key, [](const Entry& e, Symbol k) { return e.key < k; });
+        return entry != end() && entry->key == key ? entry->value : SymbolTable::cInvalidSymbol;
+    }
+
+    bool Contains(Symbol key) const { return Find(key) != SymbolTable::cInvalidSymbol; }
+
+    void Clear() {
+        mHeap.clear();
+        mSize = 0;
+    }
+
+    size_t GetSize() const { return mSize; }
+    bool IsEmpty() const { return mSize == 0; }
+
+    Entry* begin() { return GetData(); }
+    Entry* end() { return GetData() + mSize; }
+    const Entry* begin() const { return GetData(); }
+    const Entry* end() const { return GetData() + mSize; }
+
+private:
+    Entry* GetData() { return mHeap.empty() ? mInline.data() : mHeap.data(); }
+    const Entry* GetData() const { return mHeap.empty() ? mInline.data() : mHeap.data(); }
+
+    Entry* LowerBound(Symbol key) {
+        return std::lower_bound(begin(), end(), key, [](const Entry& e, Symbol k) { return e.key < k; });
+    }
+
+    void Insert(size_t index, Entry entry) {
+        if (mHeap.empty() && mSize < cInlineCapacity) {
+            std::copy_backward(mInline.begin() + index, mInline.begin() + mSize, mInline.begin() + mSize + 1);
+            mInline[index] = entry;
+        } else {
+            // spill over to the heap once, from then on the inline storage is unused
+            if (mHeap.empty())
+                mHeap.assign(mInline.begin(), mInline.begin() + mSize);
+            mHeap.insert(mHeap.begin() + index, entry);
+        }
+        ++mSize;
+    }
+
+    std::array<Entry, cInlineCapacity> mInline;
+    std::vector<Entry> mHeap{};
+    size_t mSize = 0;
+};
\ No newline at end of file
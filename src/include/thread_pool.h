@@ -0,0 +1,60 @@
+#pragma once
+
+#include "types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// simple work-stealing pool, each worker owns a queue and steals from the back of the others' when it runs dry
+class ThreadPool {
+public:
+    // tasks receive the index of the worker running them so they can use per-worker resources
+    using Task = std::function<void(u32 worker_index)>;
+
+    ThreadPool() = delete;
+    explicit ThreadPool(u32 thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    auto operator=(const ThreadPool&) = delete;
+
+    // tasks are distributed round-robin, so submitting in priority order keeps the highest priority tasks at the front of every queue
+    void Submit(Task task);
+
+    // blocks until all submitted tasks have finished, rethrows the first exception thrown by a task
+    void Wait();
+
+    u32 GetThreadCount() const { return static_cast<u32>(mThreads.size()); }
+
+    static u32 GetDefaultThreadCount() {
+        const u32 count = std::thread::hardware_concurrency();
+        return count == 0 ? 1 : count;
+    }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool TryPop(u32 index, Task& out_task);
+    void WorkerMain(u32 index);
+
+    std::vector<std::unique_ptr<WorkQueue>> mQueues{};
+    std::vector<std::thread> mThreads{};
+    std::mutex mStateMutex;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mAllDone;
+    std::exception_ptr mException = nullptr;
+    std::atomic<size_t> mQueuedCount = 0;
+    size_t mPendingCount = 0;
+    u32 mNextQueue = 0;
+    bool mShutdown = false;
+};
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "types.h"
+
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// lazily allocated MeshCodec work memory, buffers are handed out one per decompressing thread and recycled
+class WorkMemoryPool {
+public:
+    // the old fixed work memory size, known to be enough for every file in the game
+    static constexpr size_t cMaxBufferSize = 0x10000000;
+    static constexpr size_t cMinBufferSize = 0x400000;
+    static constexpr size_t cBufferAlignment = 0x100000;
+
+    class Buffer {
+    public:
+        Buffer() = default;
+        ~Buffer() { Release(); }
+
+        Buffer(const Buffer&) = delete;
+        auto operator=(const Buffer&) = delete;
+
+        Buffer(Buffer&& other) noexcept : mPool(other.mPool), mData(std::move(other.mData)), mSize(other.mSize) {
+            other.mPool = nullptr;
+            other.mSize = 0;
+        }
+
+        std::span<u8> Get() const { return { mData.get(), mSize }; }
+        size_t GetSize() const { return mSize; }
+
+        // replaces the buffer with one of at least the given size, the contents are not preserved
+        void Grow(size_t size);
+
+    private:
+        friend class WorkMemoryPool;
+
+        Buffer(WorkMemoryPool* pool, std::unique_ptr<u8[]>&& data, size_t size) : mPool(pool), mData(std::move(data)), mSize(size) {}
+
+        void Release();
+
+        WorkMemoryPool* mPool = nullptr;
+        std::unique_ptr<u8[]> mData{};
+        size_t mSize = 0;
+    };
+
+    WorkMemoryPool() = default;
+
+    WorkMemoryPool(const WorkMemoryPool&) = delete;
+    auto operator=(const WorkMemoryPool&) = delete;
+
+    Buffer Acquire(size_t size);
+
+    // estimate based on the decompressed size from mc::ResMeshCodecPackageHeader
+    static size_t GetRequiredSize(size_t decompressed_size);
+
+    // peak number of bytes allocated across all buffers at once
+    size_t GetHighWaterMark() const;
+    size_t GetBufferCount() const;
+
+private:
+    struct FreeBuffer {
+        std::unique_ptr<u8[]> data;
+        size_t size;
+    };
+
+    std::unique_ptr<u8[]> Allocate(size_t size);
+    void Free(size_t size);
+    void Return(std::unique_ptr<u8[]>&& data, size_t size);
+
+    mutable std::mutex mMutex;
+    std::vector<FreeBuffer> mFreeBuffers{};
+    size_t mAllocatedSize = 0;
+    size_t mHighWaterMark = 0;
+    size_t mBufferCount = 0;
+};
\ No newline at end of file
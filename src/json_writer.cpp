@@ -0,0 +1,211 @@
+#include "json_writer.h"
+
+#include <algorithm>
+#include <format>
+
+bool ParseOutputFormat(std::string_view name, OutputFormat& format) {
+    if (name == "json") {
+        format = OutputFormat::Json;
+    } else if (name == "jsonl") {
+        format = OutputFormat::JsonLines;
+    } else if (name == "cbor") {
+        format = OutputFormat::Cbor;
+    } else if (name == "msgpack") {
+        format = OutputFormat::MsgPack;
+    } else if (name == "matdb") {
+        format = OutputFormat::MatDb;
+    } else if (name == "text") {
+        format = OutputFormat::Text;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string_view GetFileExtension(OutputFormat format) {
+    switch (format) {
+        case OutputFormat::JsonLines:
+            return ".jsonl";
+        case OutputFormat::Cbor:
+            return ".cbor";
+        case OutputFormat::MsgPack:
+            return ".msgpack";
+        case OutputFormat::MatDb:
+            return ".matdb";
+        case OutputFormat::Text:
+            return ".txt";
+        default:
+            return ".json";
+    }
+}
+
+bool JsonLayout::IsInline(std::span<const std::string_view> path) const {
+    for (const auto& inline_path : inline_paths) {
+        std::string_view rest = inline_path;
+        size_t depth = 0;
+        for (; depth < path.size() && !rest.empty(); ++depth) {
+            const size_t end = rest.find('/');
+            const std::string_view segment = rest.substr(0, end);
+            if (segment != "*" && segment != path[depth])
+                break;
+            rest = end == std::string_view::npos ? std::string_view{} : rest.substr(end + 1);
+        }
+        if (depth == path.size() && rest.empty())
+            return true;
+    }
+    return false;
+}
+
+JsonObjectWriter::JsonObjectWriter(std::ostream& out, JsonLayout layout, OutputFormat format, size_t member_count)
+    : mOut(out), mLayout(std::move(layout)), mFormat(format), mIndent(static_cast<size_t>(std::max(mLayout.indent, 0)), ' '), mExpectedMemberCount(member_count) {
+    switch (mFormat) {
+        case OutputFormat::Json:
+        case OutputFormat::JsonLines:
+            break;
+        case OutputFormat::Cbor:
+            // indefinite-length map, closed by a break in Finish
+            mOut.put(static_cast<char>(0xbf));
+            break;
+        case OutputFormat::MsgPack: {
+            if (member_count <= 0xf) {
+                mOut.put(static_cast<char>(0x80 | member_count));
+            } else if (member_count <= 0xffff) {
+                const char header[] = { static_cast<char>(0xde), static_cast<char>(member_count >> 8), static_cast<char>(member_count) };
+                mOut.write(header, sizeof(header));
+            } else {
+                const char header[] = { static_cast<char>(0xdf), static_cast<char>(member_count >> 24), static_cast<char>(member_count >> 16),
+                                        static_cast<char>(member_count >> 8), static_cast<char>(member_count) };
+                mOut.write(header, sizeof(header));
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("JsonObjectWriter only writes json, jsonl, cbor and msgpack");
+    }
+}
+
+void JsonObjectWriter::WriteIndent(size_t depth) {
+    for (size_t i = 0; i < depth; ++i)
+        mOut << mIndent;
+}
+
+void JsonObjectWriter::WriteInline(const nlohmann::json& value) {
+    if (value.is_array()) {
+        mOut << '[';
+        bool first = true;
+        for (const auto& element : value) {
+            mOut << (first ? "" : ", ");
+            WriteInline(element);
+            first = false;
+        }
+        mOut << ']';
+    } else if (value.is_object()) {
+        mOut << '{';
+        bool first = true;
+        for (const auto& [key, member] : value.items()) {
+            mOut << (first ? "" : ", ") << nlohmann::json(key).dump() << ": ";
+            WriteInline(member);
+            first = false;
+        }
+        mOut << '}';
+    } else {
+        mOut << value.dump();
+    }
+}
+
+void JsonObjectWriter::WriteValue(const nlohmann::json& value, size_t depth) {
+    if (!value.is_structured() || value.empty()) {
+        mOut << value.dump();
+        return;
+    }
+
+    if (mLayout.IsInline(mPath)) {
+        WriteInline(value);
+        return;
+    }
+
+    // same layout nlohmann::json uses when dumping with an indent
+    if (value.is_object()) {
+        mOut << "{\n";
+        bool first = true;
+        for (const auto& [key, member] : value.items()) {
+            if (!first)
+                mOut << ",\n";
+            WriteIndent(depth + 1);
+            mOut << nlohmann::json(key).dump() << ": ";
+
+            mPath.push_back(key);
+            WriteValue(member, depth + 1);
+            mPath.pop_back();
+            first = false;
+        }
+        mOut << '\n';
+        WriteIndent(depth);
+        mOut << '}';
+    } else {
+        mOut << "[\n";
+        bool first = true;
+        for (const auto& element : value) {
+            if (!first)
+                mOut << ",\n";
+            WriteIndent(depth + 1);
+            WriteValue(element, depth + 1);
+            first = false;
+        }
+        mOut << '\n';
+        WriteIndent(depth);
+        mOut << ']';
+    }
+}
+
+void JsonObjectWriter::Write(std::string_view key, const nlohmann::json& value) {
+    switch (mFormat) {
+        case OutputFormat::JsonLines:
+            mOut << '{' << nlohmann::json(key).dump() << ':' << value.dump() << "}\n";
+            break;
+        case OutputFormat::Cbor:
+            mOut << EncodeRecord(nlohmann::json(key), mFormat) << EncodeRecord(value, mFormat);
+            break;
+        case OutputFormat::MsgPack:
+            if (mMemberCount >= mExpectedMemberCount)
+                throw std::runtime_error(std::format("MessagePack map was declared with {} member(s) but more were written", mExpectedMemberCount));
+            mOut << EncodeRecord(nlohmann::json(key), mFormat) << EncodeRecord(value, mFormat);
+            break;
+        default:
+            mOut << (mMemberCount == 0 ? "{\n" : ",\n") << mIndent << nlohmann::json(key).dump() << ": ";
+            mPath.assign(1, key);
+            WriteValue(value, 1);
+            mPath.clear();
+            break;
+    }
+
+    ++mMemberCount;
+}
+
+void JsonObjectWriter::Finish() {
+    if (mFormat == OutputFormat::JsonLines) {
+        mOut.flush();
+        return;
+    }
+
+    if (mFormat == OutputFormat::Cbor) {
+        mOut.put(static_cast<char>(0xff));
+        mOut.flush();
+        return;
+    }
+
+    if (mFormat == OutputFormat::MsgPack) {
+        if (mMemberCount != mExpectedMemberCount)
+            throw std::runtime_error(std::format("MessagePack map was declared with {} member(s) but {} were written", mExpectedMemberCount, mMemberCount));
+        mOut.flush();
+        return;
+    }
+
+    // same as dumping the default constructed json the members would otherwise have been added to
+    if (mMemberCount == 0) {
+        mOut << "null" << std::endl;
+        return;
+    }
+
+    mOut << "\n}" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "key_hash_index.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+u64 KeyHashIndex::HashKey(const u32* key, u32 width) {
+    u64 hash = 0x9e3779b97f4a7c15ull ^ width;
+    for (u32 i = 0; i < width; ++i) {
+        hash ^= key[i];
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+
+    // final avalanche so both halves of the hash are usable (the low bits pick the slot, the high bits are the tag)
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool KeyHashIndex::RowEquals(s32 index, const u32* key) const {
+    return std::memcmp(mKeyTable + static_cast<size_t>(index) * mRowWidth, key, mRowWidth * sizeof(u32)) == 0;
+}
+
+void KeyHashIndex::Build(const u32* key_table, u32 row_count, u32 row_width) {
+    mKeyTable = key_table;
+    mRowCount = row_count;
+    mRowWidth = row_width;
+
+    // keep the load factor at or below 50% so probe sequences stay short
+    const size_t capacity = std::bit_ceil(std::max<size_t>(static_cast<size_t>(row_count) * 2, 16));
+    mSlots.assign(capacity, { 0, cEmptySlot });
+    mMask = static_cast<u32>(capacity - 1);
+
+    for (u32 i = 0; i < row_count; ++i) {
+        const u32* row = key_table + static_cast<size_t>(i) * row_width;
+        const u64 hash = HashKey(row, row_width);
+        const u32 tag = static_cast<u32>(hash >> 32);
+
+        for (u32 slot = static_cast<u32>(hash) & mMask;; slot = (slot + 1) & mMask) {
+            auto& entry = mSlots[slot];
+            if (entry.index == cEmptySlot) {
+                entry = { tag, static_cast<s32>(i) };
+                break;
+            }
+
+            // duplicate keys resolve to the lowest program index, same as a linear scan would
+            if (entry.tag == tag && RowEquals(entry.index, row))
+                break;
+        }
+    }
+}
+
+s32 KeyHashIndex::Find(const u32* key) const {
+    if (mSlots.empty())
+        return -1;
+
+    const u64 hash = HashKey(key, mRowWidth);
+    const u32 tag = static_cast<u32>(hash >> 32);
+
+    for (u32 slot = static_cast<u32>(hash) & mMask;; slot = (slot + 1) & mMask) {
+        const auto& entry = mSlots[slot];
+        if (entry.index == cEmptySlot)
+            return -1;
+
+        if (entry.tag == tag && RowEquals(entry.index, key))
+            return entry.index;
+    }
+}
\ No newline at end of file
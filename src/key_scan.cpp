@@ -0,0 +1,303 @@
+#include "key_scan.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(_M_X64) || defined(__x86_64__) || defined(__i386__)
+#define KEY_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(KEY_SCAN_X86) && !defined(_MSC_VER)
+#define KEY_SCAN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KEY_SCAN_TARGET(isa)
+#endif
+
+namespace key_scan {
+
+// rows are processed 64 at a time so each block's result fits a single bitset word
+constexpr u32 cBlockSize = 64;
+
+// evaluates one op on each row in the block, passing rows set their bit
+using OpKernel = u64 (*)(const u32* key_table, u32 first_row, u32 row_count, u32 row_width, const Op& op, const u64* wide_sets);
+
+static u64 RunOpScalar(const u32* key_table, u32 first_row, u32 row_count, u32 row_width, const Op& op, const u64* wide_sets) {
+    u64 bits = 0;
+    const u32* word = key_table + static_cast<size_t>(first_row) * row_width + op.word;
+    switch (op.kind) {
+        case Op::Kind::Equal:
+            for (u32 i = 0; i < row_count; ++i, word += row_width)
+                bits |= static_cast<u64>((*word & op.mask) == op.expected) << i;
+            break;
+        case Op::Kind::Set:
+            for (u32 i = 0; i < row_count; ++i, word += row_width)
+                bits |= ((op.allowed >> ((*word & op.mask) >> op.shift)) & 1) << i;
+            break;
+        case Op::Kind::WideSet:
+            for (u32 i = 0; i < row_count; ++i, word += row_width) {
+                const u32 value = (*word & op.mask) >> op.shift;
+                const u64 match = value < op.expected ? (wide_sets[op.wide_offset + value / 64] >> (value % 64)) & 1 : 0;
+                bits |= match << i;
+            }
+            break;
+    }
+    return bits;
+}
+
+#if defined(KEY_SCAN_X86)
+KEY_SCAN_TARGET("sse2")
+static u64 RunOpSSE2(const u32* key_table, u32 first_row, u32 row_count, u32 row_width, const Op& op, const u64* wide_sets) {
+    // SSE2 has no per-lane variable shifts, so only Equal is vectorized
+    if (op.kind != Op::Kind::Equal)
+        return RunOpScalar(key_table, first_row, row_count, row_width, op, wide_sets);
+
+    const u32* word = key_table + static_cast<size_t>(first_row) * row_width + op.word;
+    const __m128i mask = _mm_set1_epi32(static_cast<s32>(op.mask));
+    const __m128i expected = _mm_set1_epi32(static_cast<s32>(op.expected));
+
+    // no gather either, the four rows are loaded individually and compared together
+    u64 bits = 0;
+    u32 i = 0;
+    for (; i + 4 <= row_count; i += 4, word += row_width * 4) {
+        const __m128i values = _mm_and_si128(_mm_set_epi32(static_cast<s32>(word[row_width * 3]), static_cast<s32>(word[row_width * 2]),
+                                                           static_cast<s32>(word[row_width]), static_cast<s32>(word[0])), mask);
+        bits |= static_cast<u64>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(values, expected)))) << i;
+    }
+
+    if (i < row_count)
+        bits |= RunOpScalar(key_table, first_row + i, row_count - i, row_width, op, wide_sets) << i;
+
+    return bits;
+}
+
+KEY_SCAN_TARGET("avx2")
+static u64 RunOpAVX2(const u32* key_table, u32 first_row, u32 row_count, u32 row_width, const Op& op, const u64* wide_sets) {
+    if (op.kind == Op::Kind::WideSet)
+        return RunOpScalar(key_table, first_row, row_count, row_width, op, wide_sets);
+
+    const u32* word = key_table + static_cast<size_t>(first_row) * row_width + op.word;
+    const __m256i mask = _mm256_set1_epi32(static_cast<s32>(op.mask));
+    const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<s32>(row_width)));
+
+    u64 bits = 0;
+    u32 i = 0;
+    if (op.kind == Op::Kind::Equal) {
+        const __m256i expected = _mm256_set1_epi32(static_cast<s32>(op.expected));
+        for (; i + 8 <= row_count; i += 8, word += row_width * 8) {
+            const __m256i values = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(word), offsets, 4), mask);
+            const __m256i match = _mm256_cmpeq_epi32(values, expected);
+            bits |= static_cast<u64>(static_cast<u32>(_mm256_movemask_ps(_mm256_castsi256_ps(match)))) << i;
+        }
+    } else {
+        // the allowed bits are split into two 32-bit halves, each lane picks its half and shifts its bit down
+        const __m128i shift = _mm_cvtsi32_si128(static_cast<s32>(op.shift));
+        const __m256i low = _mm256_set1_epi32(static_cast<s32>(op.allowed));
+        const __m256i high = _mm256_set1_epi32(static_cast<s32>(op.allowed >> 32));
+        const __m256i thirty_one = _mm256_set1_epi32(31);
+        const __m256i one = _mm256_set1_epi32(1);
+        for (; i + 8 <= row_count; i += 8, word += row_width * 8) {
+            const __m256i values = _mm256_srl_epi32(_mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(word), offsets, 4), mask), shift);
+            const __m256i half = _mm256_blendv_epi8(low, high, _mm256_cmpgt_epi32(values, thirty_one));
+            const __m256i bit = _mm256_and_si256(_mm256_srlv_epi32(half, _mm256_and_si256(values, thirty_one)), one);
+            const __m256i match = _mm256_cmpeq_epi32(bit, one);
+            bits |= static_cast<u64>(static_cast<u32>(_mm256_movemask_ps(_mm256_castsi256_ps(match)))) << i;
+        }
+    }
+
+    if (i < row_count)
+        bits |= RunOpScalar(key_table, first_row + i, row_count - i, row_width, op, wide_sets) << i;
+
+    return bits;
+}
+#endif
+
+static bool DetectAVX2() {
+#if defined(KEY_SCAN_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // the OS also has to save the ymm registers
+    const bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#elif defined(KEY_SCAN_X86)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+Backend GetBestBackend() {
+    static const Backend backend = [] {
+        if (DetectAVX2())
+            return Backend::AVX2;
+#if defined(KEY_SCAN_X86)
+        return Backend::SSE2;
+#else
+        return Backend::Scalar;
+#endif
+    }();
+    return backend;
+}
+
+std::string_view GetBackendName(Backend backend) {
+    switch (backend) {
+        case Backend::Scalar: return "scalar";
+        case Backend::SSE2: return "sse2";
+        case Backend::AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+bool IsSupported(Backend backend) {
+    return static_cast<int>(backend) <= static_cast<int>(GetBestBackend());
+}
+
+static OpKernel GetKernel(Backend backend) {
+#if defined(KEY_SCAN_X86)
+    switch (backend) {
+        case Backend::AVX2: return IsSupported(Backend::AVX2) ? RunOpAVX2 : RunOpSSE2;
+        case Backend::SSE2: return RunOpSSE2;
+        default: return RunOpScalar;
+    }
+#else
+    (void)backend;
+    return RunOpScalar;
+#endif
+}
+
+static u64 GetBlockMask(u32 row_count) {
+    return row_count == cBlockSize ? ~0ull : (1ull << row_count) - 1;
+}
+
+static f32 EstimateSelectivity(u32 allowed_count, u32 mask) {
+    // assumes every value of the field is equally likely, which says nothing useful about a whole word (allowed / 2^32 would rank it
+    // as rejecting everything), so a field that wide is assumed to reject nothing and runs last
+    const u32 bit_count = std::popcount(mask);
+    if (bit_count >= 32)
+        return 1.0f;
+
+    return std::min(static_cast<f32>(allowed_count) / static_cast<f32>(1ull << bit_count), 1.0f);
+}
+
+Program Compile(std::span<const Clause> clauses) {
+    Program program{};
+
+    for (const auto& clause : clauses) {
+        std::vector<u32> values{};
+        for (const u32 value : clause.values)
+            values.push_back(value & clause.mask);
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+
+        if (values.empty()) {
+            program.never_matches = true;
+            return program;
+        }
+
+        const u32 shift = clause.mask == 0 ? 0 : std::countr_zero(clause.mask);
+        const u32 field_max = clause.mask >> shift;
+
+        Op op{};
+        op.word = clause.word;
+        op.mask = clause.mask;
+        op.shift = shift;
+        op.selectivity = clause.selectivity >= 0.0f ? clause.selectivity : EstimateSelectivity(static_cast<u32>(values.size()), clause.mask);
+
+        if (values.size() == 1) {
+            op.kind = Op::Kind::Equal;
+            op.expected = values[0];
+
+            // several single valued clauses on one word collapse into a single compare
+            auto it = std::find_if(program.ops.begin(), program.ops.end(), [&op](const Op& other) {
+                return other.kind == Op::Kind::Equal && other.word == op.word;
+            });
+            if (it != program.ops.end()) {
+                const u32 overlap = it->mask & op.mask;
+                if ((it->expected & overlap) != (op.expected & overlap)) {
+                    program.never_matches = true;
+                    return program;
+                }
+                it->mask |= op.mask;
+                it->expected |= op.expected;
+                it->selectivity *= op.selectivity;
+                continue;
+            }
+        } else if (field_max < 64) {
+            op.kind = Op::Kind::Set;
+            for (const u32 value : values)
+                op.allowed |= 1ull << (value >> shift);
+
+            // every possible value is allowed, the clause never rejects anything
+            if (op.allowed == (field_max == 63 ? ~0ull : (1ull << (field_max + 1)) - 1))
+                continue;
+        } else {
+            op.kind = Op::Kind::WideSet;
+            op.expected = (values.back() >> shift) + 1;
+            op.wide_offset = static_cast<u32>(program.wide_sets.size());
+            program.wide_sets.resize(program.wide_sets.size() + (op.expected + 63) / 64);
+            for (const u32 value : values)
+                program.wide_sets[op.wide_offset + (value >> shift) / 64] |= 1ull << ((value >> shift) % 64);
+        }
+
+        program.ops.push_back(op);
+    }
+
+    std::stable_sort(program.ops.begin(), program.ops.end(), [](const Op& a, const Op& b) { return a.selectivity < b.selectivity; });
+
+    return program;
+}
+
+void Run(const Program& program, const u32* key_table, u32 row_count, u32 row_width, std::vector<u64>& out_matches, Backend backend) {
+    const OpKernel kernel = GetKernel(backend);
+    const u64* wide_sets = program.wide_sets.data();
+
+    out_matches.assign((row_count + cBlockSize - 1) / cBlockSize, 0);
+    if (program.never_matches)
+        return;
+
+    for (u32 block = 0; block < out_matches.size(); ++block) {
+        const u32 first_row = block * cBlockSize;
+        const u32 block_rows = std::min(cBlockSize, row_count - first_row);
+
+        u64 bits = GetBlockMask(block_rows);
+        for (const auto& op : program.ops) {
+            bits &= kernel(key_table, first_row, block_rows, row_width, op, wide_sets);
+            if (bits == 0)
+                break;
+        }
+        out_matches[block] = bits;
+    }
+}
+
+void Scan(const u32* key_table, u32 row_count, u32 row_width, std::span<const Clause> clauses, std::vector<u64>& out_matches, Backend backend) {
+    Run(Compile(clauses), key_table, row_count, row_width, out_matches, backend);
+}
+
+s32 FindExact(const u32* key_table, u32 row_count, u32 row_width, const u32* key, Backend backend) {
+    const OpKernel kernel = GetKernel(backend);
+
+    // every word has to match exactly, the first word usually rules out most rows so the rest are rarely evaluated
+    for (u32 first_row = 0; first_row < row_count; first_row += cBlockSize) {
+        const u32 block_rows = std::min(cBlockSize, row_count - first_row);
+
+        u64 bits = GetBlockMask(block_rows);
+        for (u32 i = 0; i < row_width && bits != 0; ++i) {
+            const Op op = { Op::Kind::Equal, i, 0xffffffff, key[i], 0, 0, 0, 0.0f };
+            bits &= kernel(key_table, first_row, block_rows, row_width, op, nullptr);
+        }
+
+        if (bits != 0)
+            return static_cast<s32>(first_row + std::countr_zero(bits));
+    }
+
+    return -1;
+}
+
+} // namespace key_scan
\ No newline at end of file
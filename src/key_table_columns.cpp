@@ -0,0 +1,48 @@
+#include "key_table_columns.h"
+
+#include <algorithm>
+
+void KeyTableColumns::Initialize(const g3d2::ResShadingModel* model) {
+    mModel = model;
+    mOptionCount = static_cast<u32>(model->static_option_count) + model->dynamic_option_count;
+    mColumns = std::make_unique<ColumnData[]>(mOptionCount);
+}
+
+const KeyTableColumns::Column& KeyTableColumns::Get(u32 option_slot) const {
+    auto& data = mColumns[option_slot];
+
+    std::call_once(data.decoded, [this, option_slot, &data] {
+        Decode(option_slot, data.column);
+    });
+
+    return data.column;
+}
+
+template <typename T>
+static void DecodeColumn(const u32* key, u32 row_count, u32 row_width, u32 mask, u32 shift, std::vector<T>& out, std::vector<u32>& histogram) {
+    // values past the choice count shouldn't exist, they're stored as the choice count (which always fits T) rather than cast down,
+    // where they could alias a valid choice, and aren't counted
+    const u32 choice_count = static_cast<u32>(histogram.size());
+    out.resize(row_count);
+    for (u32 row = 0; row < row_count; ++row, key += row_width)
+        out[row] = static_cast<T>(std::min((*key & mask) >> shift, choice_count));
+
+    for (const T value : out) {
+        if (value < histogram.size())
+            ++histogram[value];
+    }
+}
+
+void KeyTableColumns::Decode(u32 option_slot, Column& column) const {
+    const bool is_dynamic = option_slot >= mModel->static_option_count;
+    const g3d2::ResShaderOption* option = GetOption(option_slot);
+    const u32 word = is_dynamic ? mModel->static_key_count + option->option_index - option->dynamic_index_offset : option->option_index;
+    const u32 row_width = mModel->static_key_count + mModel->dynamic_key_count;
+
+    column.mHistogram.assign(option->choice_count, 0);
+    if (option->choice_count >= 0x100) {
+        DecodeColumn(mModel->key_table + word, mModel->shader_program_count, row_width, option->option_mask, option->bit_offset, column.mWide, column.mHistogram);
+    } else {
+        DecodeColumn(mModel->key_table + word, mModel->shader_program_count, row_width, option->option_mask, option->bit_offset, column.mNarrow, column.mHistogram);
+    }
+}
\ No newline at end of file
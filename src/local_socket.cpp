@@ -0,0 +1,246 @@
+#include "local_socket.h"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+LocalSocket& LocalSocket::operator=(LocalSocket&& other) noexcept {
+    if (this != &other) {
+        Close();
+        mPath = std::move(other.mPath);
+        mBuffer = std::move(other.mBuffer);
+        mBufferOffset = std::exchange(other.mBufferOffset, 0);
+        mHandle = std::exchange(other.mHandle, -1);
+        mWakeHandles[0] = std::exchange(other.mWakeHandles[0], -1);
+        mWakeHandles[1] = std::exchange(other.mWakeHandles[1], -1);
+        mOwnsHandle = std::exchange(other.mOwnsHandle, true);
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool LocalSocket::IsSupported() {
+    return false;
+}
+
+bool LocalSocket::Listen(const std::string&, int) {
+    return false;
+}
+
+LocalSocket LocalSocket::OpenStandardInput() {
+    return LocalSocket();
+}
+
+LocalSocket LocalSocket::Accept() {
+    return LocalSocket();
+}
+
+bool LocalSocket::ReadLine(std::string&) {
+    return false;
+}
+
+bool LocalSocket::Write(std::string_view) {
+    return false;
+}
+
+void LocalSocket::Shutdown() {}
+
+void LocalSocket::Close() {}
+
+#else
+
+bool LocalSocket::IsSupported() {
+    return true;
+}
+
+bool LocalSocket::CreateWakePipe() {
+    if (pipe(mWakeHandles) != 0) {
+        mWakeHandles[0] = mWakeHandles[1] = -1;
+        return false;
+    }
+
+    // Shutdown must never block, even if it's called many times before anyone polls
+    fcntl(mWakeHandles[1], F_SETFL, fcntl(mWakeHandles[1], F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+bool LocalSocket::WaitReadable() const {
+    pollfd handles[] = {
+        { mHandle, POLLIN, 0 },
+        { mWakeHandles[0], POLLIN, 0 },
+    };
+    while (true) {
+        if (poll(handles, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        // woken up by Shutdown
+        if (handles[1].revents != 0)
+            return false;
+        if (handles[0].revents != 0)
+            return true;
+    }
+}
+
+bool LocalSocket::Listen(const std::string& path, int backlog) {
+    Close();
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    // only a stale socket is removed, anything else at the path (e.g. a mistyped output file) is left alone
+    struct stat info{};
+    if (lstat(path.c_str(), &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            errno = EEXIST;
+            return false;
+        }
+        unlink(path.c_str());
+    }
+
+    const int handle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (handle < 0)
+        return false;
+
+    if (bind(handle, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || listen(handle, backlog) != 0) {
+        const int error = errno;
+        close(handle);
+        errno = error;
+        return false;
+    }
+
+    mHandle = handle;
+    mPath = path;
+    if (!CreateWakePipe()) {
+        const int error = errno;
+        Close();
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+LocalSocket LocalSocket::OpenStandardInput() {
+    LocalSocket input(STDIN_FILENO);
+    input.mOwnsHandle = false;
+    if (!input.CreateWakePipe())
+        return LocalSocket();
+    return input;
+}
+
+LocalSocket LocalSocket::Accept() {
+    while (mHandle >= 0 && WaitReadable()) {
+        const int handle = accept(mHandle, nullptr, nullptr);
+        if (handle >= 0) {
+#ifdef SO_NOSIGPIPE
+            const int enable = 1;
+            setsockopt(handle, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+            LocalSocket client(handle);
+            // a client that couldn't be woken up would keep the server from stopping, so it isn't served at all
+            if (!client.CreateWakePipe())
+                continue;
+            return client;
+        }
+        if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN && errno != EWOULDBLOCK)
+            break;
+    }
+    return LocalSocket();
+}
+
+bool LocalSocket::ReadLine(std::string& line) {
+    while (true) {
+        const size_t end = mBuffer.find('\n', mBufferOffset);
+        if (end != std::string::npos) {
+            line.assign(mBuffer, mBufferOffset, end - mBufferOffset);
+            mBufferOffset = end + 1;
+            return true;
+        }
+
+        // drop the lines already handed out before growing the buffer
+        mBuffer.erase(0, mBufferOffset);
+        mBufferOffset = 0;
+
+        if (mHandle < 0 || !WaitReadable())
+            return false;
+
+        // read rather than recv so this works for stdin as well
+        char chunk[0x1000];
+        const ssize_t size = read(mHandle, chunk, sizeof(chunk));
+        if (size > 0) {
+            mBuffer.append(chunk, static_cast<size_t>(size));
+            continue;
+        }
+        if (size < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+            continue;
+
+        // a final line without a trailing newline still counts
+        if (mBuffer.empty())
+            return false;
+        line = std::move(mBuffer);
+        mBuffer.clear();
+        return true;
+    }
+}
+
+bool LocalSocket::Write(std::string_view data) {
+#ifdef MSG_NOSIGNAL
+    constexpr int flags = MSG_NOSIGNAL;
+#else
+    constexpr int flags = 0;
+#endif
+    while (!data.empty() && mHandle >= 0) {
+        const ssize_t size = send(mHandle, data.data(), data.size(), flags);
+        if (size < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(size));
+    }
+    return data.empty();
+}
+
+void LocalSocket::Shutdown() {
+    // a byte in the wake pipe makes every current and future wait return, unlike shutdown() on a listening socket this works everywhere
+    if (mWakeHandles[1] >= 0) {
+        const char wake = 0;
+        [[maybe_unused]] const ssize_t size = write(mWakeHandles[1], &wake, 1);
+    }
+}
+
+void LocalSocket::Close() {
+    if (mHandle >= 0 && mOwnsHandle)
+        close(mHandle);
+    for (int& handle : mWakeHandles) {
+        if (handle >= 0)
+            close(handle);
+        handle = -1;
+    }
+    if (!mPath.empty())
+        unlink(mPath.c_str());
+
+    mHandle = -1;
+    mOwnsHandle = true;
+    mPath.clear();
+    mBuffer.clear();
+    mBufferOffset = 0;
+}
+
+#endif
\ No newline at end of file
@@ -29,6 +29,17 @@ static void MakeMissingDirectories(const std::string_view path, bool is_dir = fa
     }
 }
 
+// prints an error if the name isn't a format or the action doesn't support it
+static bool ParseFormatOption(const std::string& name, std::initializer_list<OutputFormat> supported, OutputFormat& format) {
+    OutputFormat parsed;
+    if (!ParseOutputFormat(name, parsed) || std::find(supported.begin(), supported.end(), parsed) == supported.end()) {
+        std::cerr << "Unsupported output format: " << name << "\n";
+        return false;
+    }
+    format = parsed;
+    return true;
+}
+
 int main(int argc , const char* argv[]) {
 
     int opt_index = 0;
@@ -40,10 +51,31 @@ int main(int argc , const char* argv[]) {
         std::string external_binary_string_path = "";
         std::string output_path = "";
         std::string romfs_path = "";
+        std::string selection_index_path = "";
+        JsonLayout layout = MaterialParser::cDefaultLayout;
+        bool default_inline_paths = true;
+        OutputFormat output_format = OutputFormat::Json;
+        u32 job_count = 1;
         while (opt_index + 1 < argc) {
             const std::string next_opt = ParseInput(argc, argv, opt_index++);
             if (next_opt == "--shader-archive" || next_opt == "-a") {
                 material_archive_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--indent") {
+                layout.indent = std::stoi(ParseInput(argc, argv, opt_index++));
+            } else if (next_opt == "--inline") {
+                // the first path given replaces the defaults
+                if (default_inline_paths) {
+                    layout.inline_paths.clear();
+                    default_inline_paths = false;
+                }
+                layout.inline_paths.push_back(ParseInput(argc, argv, opt_index++));
+            } else if (next_opt == "--no-inline") {
+                layout.inline_paths.clear();
+                default_inline_paths = false;
+            } else if (next_opt == "--format" || next_opt == "-f") {
+                if (!ParseFormatOption(ParseInput(argc, argv, opt_index++), { OutputFormat::Json, OutputFormat::JsonLines, OutputFormat::Cbor, OutputFormat::MsgPack, OutputFormat::MatDb }, output_format)) {
+                    return 1;
+                }
             } else if (next_opt == "--external-binary-string" || next_opt == "-e") {
                 external_binary_string_path = ParseInput(argc, argv, opt_index++);
             } else if (next_opt == "--out" || next_opt == "-o") {
@@ -53,13 +85,19 @@ int main(int argc , const char* argv[]) {
                 }
             } else if (next_opt == "--romfs" || next_opt == "-r") {
                 romfs_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--jobs" || next_opt == "-j") {
+                job_count = static_cast<u32>(std::stoul(ParseInput(argc, argv, opt_index++)));
+            } else if (next_opt == "--selection-index") {
+                selection_index_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--timing") {
+                AppContext::sReportTiming = true;
             } else {
                 romfs_path = next_opt;
             }
         }
         MakeMissingDirectories(output_path);
         try {
-            MaterialParser(romfs_path, material_archive_path, external_binary_string_path, output_path).Run();
+            MaterialParser(romfs_path, material_archive_path, external_binary_string_path, output_path, job_count, selection_index_path, layout, output_format).Run();
         } catch (const std::runtime_error& e) {
             std::cerr << "Exception caught: [" << e.what() << "]\n";
             return 1;
@@ -68,13 +106,25 @@ int main(int argc , const char* argv[]) {
         std::string config_path = "";
         std::string material_archive_path = "";
         std::string output_path = "";
+        std::string selection_index_path = "";
         bool verbose = false;
+        bool explain = false;
+        OutputFormat output_format = OutputFormat::Text;
+        u32 job_count = 1;
         while (opt_index + 1 < argc) {
             const std::string next_opt = ParseInput(argc, argv, opt_index++);
             if (next_opt == "--shader-archive" || next_opt == "-a") {
                 material_archive_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--format" || next_opt == "-f") {
+                if (!ParseFormatOption(ParseInput(argc, argv, opt_index++), { OutputFormat::Text, OutputFormat::Json, OutputFormat::JsonLines, OutputFormat::Cbor, OutputFormat::MsgPack }, output_format)) {
+                    return 1;
+                }
             } else if (next_opt == "--verbose" || next_opt == "-v") {
                 verbose = true;
+            } else if (next_opt == "--explain") {
+                explain = true;
+            } else if (next_opt == "--jobs" || next_opt == "-j") {
+                job_count = static_cast<u32>(std::stoul(ParseInput(argc, argv, opt_index++)));
             } else if (next_opt == "--out" || next_opt == "-o") {
                 output_path = ParseInput(argc, argv, opt_index++);
                 if (output_path == "-") {
@@ -82,13 +132,44 @@ int main(int argc , const char* argv[]) {
                 }
             } else if (next_opt == "--config" || next_opt == "-c") {
                 config_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--selection-index") {
+                selection_index_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--timing") {
+                AppContext::sReportTiming = true;
             } else {
                 config_path = next_opt;
             }
         }
         MakeMissingDirectories(output_path);
         try {
-            MaterialSearcher(config_path, material_archive_path, output_path, verbose).Run();
+            MaterialSearcher(config_path, material_archive_path, output_path, verbose, selection_index_path, explain, job_count, output_format).Run();
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Exception caught: [" << e.what() << "]\n";
+            return 1;
+        }
+    } else if (opt == "serve") {
+        std::string material_archive_path = "";
+        std::string selection_index_path = "";
+        std::string socket_path = "";
+        u32 job_count = 1;
+        while (opt_index + 1 < argc) {
+            const std::string next_opt = ParseInput(argc, argv, opt_index++);
+            if (next_opt == "--shader-archive" || next_opt == "-a") {
+                material_archive_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--selection-index") {
+                selection_index_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--socket" || next_opt == "-s") {
+                socket_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--jobs" || next_opt == "-j") {
+                job_count = static_cast<u32>(std::stoul(ParseInput(argc, argv, opt_index++)));
+            } else if (next_opt == "--timing") {
+                AppContext::sReportTiming = true;
+            } else {
+                material_archive_path = next_opt;
+            }
+        }
+        try {
+            MaterialServer(material_archive_path, selection_index_path, socket_path, job_count).Run();
         } catch (const std::runtime_error& e) {
             std::cerr << "Exception caught: [" << e.what() << "]\n";
             return 1;
@@ -100,10 +181,15 @@ int main(int argc , const char* argv[]) {
         bool dump_opts = true;
         bool dump_bin = false;
         int program_index = -1;
+        OutputFormat output_format = OutputFormat::Json;
         while (opt_index + 1 < argc) {
             const std::string next_opt = ParseInput(argc, argv, opt_index++);
             if (next_opt == "--out" || next_opt == "-o") {
                 output_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--format" || next_opt == "-f") {
+                if (!ParseFormatOption(ParseInput(argc, argv, opt_index++), { OutputFormat::Json, OutputFormat::JsonLines, OutputFormat::Cbor, OutputFormat::MsgPack }, output_format)) {
+                    return 1;
+                }
             } else if (next_opt == "--no-options" || next_opt == "-n") {
                 dump_opts = false;
             } else if (next_opt == "--dump-bin") {
@@ -114,13 +200,15 @@ int main(int argc , const char* argv[]) {
                 program_index = std::stoi(ParseInput(argc, argv, opt_index++));
             } else if (next_opt == "--shader-archive" || next_opt == "-a") {
                 archive_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--timing") {
+                AppContext::sReportTiming = true;
             } else {
                 archive_path = next_opt;
             }
         }
         MakeMissingDirectories(output_path);
         try {
-            ShaderInfoPrinter(archive_path, output_path, model_name, program_index, dump_opts, dump_bin).Run();
+            ShaderInfoPrinter(archive_path, output_path, model_name, program_index, dump_opts, dump_bin, output_format).Run();
         } catch (const std::runtime_error& e) {
             std::cerr << "Exception caught: [" << e.what() << "]\n";
             return 1;
@@ -140,6 +228,8 @@ int main(int argc , const char* argv[]) {
                 program_index = std::stoi(ParseInput(argc, argv, opt_index++));
             } else if (next_opt == "--shader-archive" || next_opt == "-a") {
                 archive_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--timing") {
+                AppContext::sReportTiming = true;
             } else {
                 archive_path = next_opt;
             }
@@ -151,6 +241,97 @@ int main(int argc , const char* argv[]) {
             std::cerr << "Exception caught: [" << e.what() << "]\n";
             return 1;
         }
+    } else if (opt == "bench") {
+        std::string archive_path = "";
+        std::string model_name = "";
+        u32 iterations = 20;
+        while (opt_index + 1 < argc) {
+            const std::string next_opt = ParseInput(argc, argv, opt_index++);
+            if (next_opt == "--model-name" || next_opt == "-m") {
+                model_name = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--iterations" || next_opt == "-n") {
+                iterations = static_cast<u32>(std::stoul(ParseInput(argc, argv, opt_index++)));
+            } else if (next_opt == "--shader-archive" || next_opt == "-a") {
+                archive_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--timing") {
+                AppContext::sReportTiming = true;
+            } else {
+                archive_path = next_opt;
+            }
+        }
+        try {
+            ScanBenchmark(archive_path, model_name, iterations).Run();
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Exception caught: [" << e.what() << "]\n";
+            return 1;
+        }
+    } else if (opt == "query") {
+        std::string database_path = "";
+        std::string output_path = "";
+        std::string file_name = "";
+        std::string model_name = "";
+        std::string material_name = "";
+        s32 program_index = -1;
+        OutputFormat output_format = OutputFormat::Json;
+        while (opt_index + 1 < argc) {
+            const std::string next_opt = ParseInput(argc, argv, opt_index++);
+            if (next_opt == "--out" || next_opt == "-o") {
+                output_path = ParseInput(argc, argv, opt_index++);
+                if (output_path == "-") {
+                    output_path = "";
+                }
+            } else if (next_opt == "--format" || next_opt == "-f") {
+                if (!ParseFormatOption(ParseInput(argc, argv, opt_index++), { OutputFormat::Json, OutputFormat::JsonLines, OutputFormat::Cbor, OutputFormat::MsgPack }, output_format)) {
+                    return 1;
+                }
+            } else if (next_opt == "--file") {
+                file_name = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--model-name" || next_opt == "-m") {
+                model_name = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--material") {
+                material_name = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--program" || next_opt == "--index" || next_opt == "-i") {
+                program_index = std::stoi(ParseInput(argc, argv, opt_index++));
+            } else if (next_opt == "--timing") {
+                AppContext::sReportTiming = true;
+            } else {
+                database_path = next_opt;
+            }
+        }
+        MakeMissingDirectories(output_path);
+        try {
+            MaterialQuery(database_path, output_path, file_name, model_name, material_name, program_index, output_format).Run();
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Exception caught: [" << e.what() << "]\n";
+            return 1;
+        }
+    } else if (opt == "index") {
+        const std::string sub_opt = ParseInput(argc, argv, opt_index++);
+        if (sub_opt != "build") {
+            std::cerr << "Unknown index action: " << sub_opt << "\n";
+            return 1;
+        }
+        std::string archive_path = "";
+        std::string output_path = "";
+        while (opt_index + 1 < argc) {
+            const std::string next_opt = ParseInput(argc, argv, opt_index++);
+            if (next_opt == "--out" || next_opt == "-o") {
+                output_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--shader-archive" || next_opt == "-a") {
+                archive_path = ParseInput(argc, argv, opt_index++);
+            } else if (next_opt == "--timing") {
+                AppContext::sReportTiming = true;
+            } else {
+                archive_path = next_opt;
+            }
+        }
+        MakeMissingDirectories(output_path);
+        try {
+            SelectionIndexBuilder(archive_path, output_path).Run();
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Exception caught: [" << e.what() << "]\n";
+            return 1;
+        }
     } else if (opt == "" || opt == "help") {
         std::cout <<
         "Material Tool\n"
@@ -161,15 +342,35 @@ int main(int argc , const char* argv[]) {
         "    Arguments:\n"
         "      --shader-archive         : path to material bfsha shader archive (needs to be decompressed); defaults to 'material.Product.140.product.Nin_NX_NVN.bfsha'\n"
         "      --external-binary-string : path to ExternalBinaryString.bfres.mc; defaults to romfs_path/Shader/ExternalBinaryString.bfres.mc\n"
-        "      --out                    : path to file to output to; defaults to 'Materials.json'\n"
+        "      --out                    : path to file to output to; defaults to 'Materials' with the format's extension (.json, .jsonl, .cbor, .msgpack or .matdb)\n"
+        "      --jobs                   : number of worker threads to process files with, 0 to use all available cores; defaults to 1\n"
+        "      --selection-index        : path to a selection index built with index build, used in place of the shader archive\n"
+        "      --indent                 : number of spaces to indent each level of the output by; defaults to 2\n"
+        "      --inline                 : key path of arrays/objects to write on a single line, keys separated by '/' with '*' matching any key (file/model/material/key),\n"
+        "                                 may be given multiple times and replaces the defaults; defaults to '*/*/*/Samplers', '*/*/*/Skin Counts' and '*/*/*/Textures'\n"
+        "      --no-inline              : write every array/object across multiple lines\n"
+        "      --format                 : output format, json, jsonl (one line per file), cbor, msgpack or matdb (a memory-mappable material database that can be read with query); defaults to json\n"
         "      romfs_path               : path to romfs with Models directory\n"
         "  search [options] query_config\n"
         "    Searches a shader archive for matching shaders given the a set of conditions (useful for material design)\n"
+        "    A directory of configs or a JSON Lines file (.jsonl) of configs is answered in one go, writing one record per query tagged with its id (a JSON line, or a CBOR/MessagePack item)\n"
         "    Arguments:\n"
         "      --shader-archive         : path to the shader archive (needs to be decompressed); defaults to 'material.Product.140.product.Nin_NX_NVN.bfsha'\n"
         "      --verbose                : print all non-default shader options (as opposed to just the specified ones); defaults to false\n"
+        "      --explain                : print the order constraints are evaluated in and how many programs each one eliminated; defaults to false\n"
+        "      --format                 : output format, text, json, jsonl, cbor or msgpack; defaults to text (json lines in batch mode)\n"
+        "      --jobs                   : number of queries to answer in parallel in batch mode, 0 to use all available cores; defaults to 1\n"
+        "      --selection-index        : path to a selection index built with index build, used in place of the shader archive\n"
         "      --out                    : path to file to output to; defaults to stdout\n"
-        "      query_config             : path to JSON search config file\n"
+        "      query_config             : path to JSON search config file, JSON Lines file or directory of config files\n"
+        "  serve [options] shader_archive\n"
+        "    Keeps the shader archive loaded and answers newline-delimited JSON requests, one JSON response line per request\n"
+        "    Requests have an Action (select, search, info or shutdown) and an optional Id that is echoed back along with the latency\n"
+        "    Arguments:\n"
+        "      --shader-archive         : path to the shader archive (needs to be decompressed); defaults to 'material.Product.140.product.Nin_NX_NVN.bfsha'\n"
+        "      --selection-index        : path to a selection index built with index build, used in place of the shader archive\n"
+        "      --socket                 : path of a unix domain socket to listen on, each connected client is served concurrently; defaults to stdin/stdout\n"
+        "      --jobs                   : number of requests to answer in parallel when serving stdin, 0 to use all available cores; defaults to 1\n"
         "  info [options] shader_archive\n"
         "    Outputs information about specified shading model(s) (or shader program if a program index is provided)\n"
         "    Arguments:\n"
@@ -178,19 +379,57 @@ int main(int argc , const char* argv[]) {
         "      --index                  : index of shader program to dump information about, ignore to dump information about an entire shading model; defaults to -1\n"
         "      --no-options             : skip dumping of shader options in output; defaults to include options\n"
         "      --dump-bin               : dump shader code and control to files, ignored if no program index is specified; defaults to off\n"
-        "      --out                    : path to file to output to; defaults to 'ShaderInfo.json'\n"
+        "      --format                 : output format, json, jsonl (the whole output on one line), cbor or msgpack; defaults to json\n"
+        "      --out                    : path to file to output to; defaults to 'ShaderInfo' with the format's extension\n"
         "  extract [options] shader_archive\n"
         "    Extract shader binaries from the specified model in the archive, files are named {archive_name}_{model_name}_{index}_{shader_stage}_{type}.bin\n"
         "    Arguments:\n"
         "      --shader-archive         : path to the shader archive (needs to be decompressed); defaults to 'material.Product.140.product.Nin_NX_NVN.bfsha'\n"
         "      --model-name             : name of shading model to extract from; defaults to material\n"
         "      --index                  : index of shader program to dump, ignore to dump all shaders in the model; defaults to -1\n"
-        "      --out                    : path to output directory; defaults to the current directory\n\n"
+        "      --out                    : path to output directory; defaults to the current directory\n"
+        "  query [options] material_database\n"
+        "    Looks up materials in a database written by dump --format matdb, matches are written the same way dump writes them\n"
+        "    Arguments:\n"
+        "      --file                   : only materials in the model file with this name (e.g. Npc_Zelda.bfres.mc)\n"
+        "      --model-name             : only materials in models with this name\n"
+        "      --material               : only materials with this name\n"
+        "      --index                  : only materials that select this shader program for at least one skin count\n"
+        "      --format                 : output format, json, jsonl, cbor or msgpack; defaults to json\n"
+        "      --out                    : path to file to output to; defaults to stdout\n"
+        "      material_database        : path to the material database; defaults to 'Materials.matdb'\n"
+        "  index build [options] shader_archive\n"
+        "    Builds a compact selection index (option tables and key tables only) that loads much faster than the full shader archive\n"
+        "    Arguments:\n"
+        "      --shader-archive         : path to the shader archive (needs to be decompressed); defaults to 'material.Product.140.product.Nin_NX_NVN.bfsha'\n"
+        "      --out                    : path to file to output to; defaults to 'SelectionIndex.bin'\n"
+        "  bench [options] shader_archive\n"
+        "    Measures key table scan throughput (rows/second) of the old scalar loops against each supported SIMD backend\n"
+        "    Arguments:\n"
+        "      --shader-archive         : path to the shader archive (needs to be decompressed); defaults to 'material.Product.140.product.Nin_NX_NVN.bfsha'\n"
+        "      --model-name             : name of shading model to scan; defaults to material\n"
+        "      --iterations             : number of times each scan is repeated; defaults to 20\n"
+        "  All actions also accept:\n"
+        "      --timing                 : print how long loading and relocating files took\n\n"
         "Examples:\n"
         "  Dump information about materials in romfs:\n"
         "    mat-tool dump TotK_ROMFS/\n"
+        "  Dump information about materials in romfs using all available cores:\n"
+        "    mat-tool dump --jobs 0 TotK_ROMFS/\n"
+        "  Build a selection index and use it to dump materials:\n"
+        "    mat-tool index build material.Product.140.product.Nin_NX_NVN.bfsha\n"
+        "    mat-tool dump --selection-index SelectionIndex.bin TotK_ROMFS/\n"
+        "  Dump materials to a material database and find every material using shader program 123:\n"
+        "    mat-tool dump --format matdb TotK_ROMFS/\n"
+        "    mat-tool query --index 123 Materials.matdb\n"
+        "  Dump materials as MessagePack, one map of files like the JSON output:\n"
+        "    mat-tool dump --format msgpack TotK_ROMFS/\n"
         "  Search for matching shaders:\n"
         "    mat-tool search query.json\n"
+        "  Answer every query in a JSON Lines file using all available cores:\n"
+        "    mat-tool search --jobs 0 --out results.jsonl queries.jsonl\n"
+        "  Serve queries over a unix domain socket:\n"
+        "    mat-tool serve --selection-index SelectionIndex.bin --socket /tmp/mat-tool.sock\n"
         "  Output information about the material shading model in material.Product.140.product.Nin_NX_NVN.bfsha\n"
         "    mat-tool info --shader-archive material.Product.140.product.Nin_NX_NVN.bfsha --model-name material\n";
     } else {
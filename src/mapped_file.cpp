@@ -0,0 +1,141 @@
+#include "mapped_file.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        Close();
+        mData = std::exchange(other.mData, nullptr);
+        mSize = std::exchange(other.mSize, 0);
+#ifdef _WIN32
+        mMappingHandle = std::exchange(other.mMappingHandle, nullptr);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& path, Access access, Advice advice) {
+    Close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              advice == Advice::Random ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, access == Access::CopyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+        return false;
+
+    void* data = MapViewOfFile(mapping, access == Access::CopyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    mData = static_cast<u8*>(data);
+    mSize = static_cast<size_t>(size.QuadPart);
+    mMappingHandle = mapping;
+
+    return true;
+}
+
+void MappedFile::Close() {
+    if (mData != nullptr)
+        UnmapViewOfFile(mData);
+    if (mMappingHandle != nullptr)
+        CloseHandle(mMappingHandle);
+
+    mData = nullptr;
+    mSize = 0;
+    mMappingHandle = nullptr;
+}
+
+void MappedFile::Advise(Advice) const {
+    // access pattern hints are passed when opening the file on windows
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path, Access access, Advice advice) {
+    Close();
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    // MAP_PRIVATE gives us copy-on-write pages, relocation only dirties the pages it actually writes to
+    const int prot = access == Access::CopyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), prot, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    mData = static_cast<u8*>(data);
+    mSize = static_cast<size_t>(st.st_size);
+
+    Advise(advice);
+
+    return true;
+}
+
+void MappedFile::Close() {
+    if (mData != nullptr)
+        munmap(mData, mSize);
+
+    mData = nullptr;
+    mSize = 0;
+}
+
+void MappedFile::Advise(Advice advice) const {
+    if (mData == nullptr)
+        return;
+
+    switch (advice) {
+        case Advice::Normal: madvise(mData, mSize, MADV_NORMAL); break;
+        case Advice::Sequential: madvise(mData, mSize, MADV_SEQUENTIAL); break;
+        case Advice::Random: madvise(mData, mSize, MADV_RANDOM); break;
+        case Advice::WillNeed: madvise(mData, mSize, MADV_WILLNEED); break;
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "material_db.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+namespace material_db {
+
+u64 HashString(std::string_view str) {
+    u64 hash = 0xcbf29ce484222325ull;
+    for (const char c : str) {
+        hash ^= static_cast<u8>(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+} // namespace material_db
+
+using namespace material_db;
+
+u32 MaterialDbBuilder::AddString(std::string_view str) {
+    if (const auto it = mStringIds.find(std::string(str)); it != mStringIds.end())
+        return it->second;
+
+    const u32 id = static_cast<u32>(mStringOffsets.size() - 1);
+    mStringData.append(str);
+    mStringOffsets.push_back(static_cast<u32>(mStringData.size()));
+    mStringIds.emplace(str, id);
+    return id;
+}
+
+Range MaterialDbBuilder::AddValues(const nlohmann::json& values) {
+    const Range range{ static_cast<u32>(mValues.size()), static_cast<u32>(values.size()) };
+    for (const auto& [key, value] : values.items()) {
+        Value entry{ AddString(key), ValueType::Bool, 0 };
+        if (value.is_boolean()) {
+            entry.data = value.get<bool>() ? 1 : 0;
+        } else if (value.is_number_float()) {
+            entry.type = ValueType::Float;
+            entry.data = std::bit_cast<u32>(value.get<f32>());
+        } else if (value.is_number()) {
+            entry.type = ValueType::Int;
+            entry.data = std::bit_cast<u32>(value.get<s32>());
+        } else if (value.is_string()) {
+            entry.type = ValueType::String;
+            entry.data = AddString(value.get<std::string>());
+        } else {
+            throw std::runtime_error(std::format("Unsupported value type for {}: {}", key, value.type_name()));
+        }
+        mValues.push_back(entry);
+    }
+    return range;
+}
+
+Range MaterialDbBuilder::AddNames(const nlohmann::json& names) {
+    const Range range{ static_cast<u32>(mNames.size()), static_cast<u32>(names.size()) };
+    for (const auto& name : names)
+        mNames.push_back(AddString(name.get<std::string>()));
+    return range;
+}
+
+void MaterialDbBuilder::AddFile(std::string_view filename, const nlohmann::json& info) {
+    // files are found by binary search, so they have to come in sorted order (the order dump visits them in)
+    if (!mFiles.empty()) {
+        const File& last = mFiles.back();
+        const std::string_view last_name(mStringData.data() + mStringOffsets[last.name], mStringOffsets[last.name + 1] - mStringOffsets[last.name]);
+        if (filename <= last_name)
+            throw std::runtime_error(std::format("Material database files have to be added in name order: {} after {}", filename, last_name));
+    }
+
+    const u32 file_index = static_cast<u32>(mFiles.size());
+    File file{ AddString(filename), { static_cast<u32>(mModels.size()), 0 }, { static_cast<u32>(mMaterials.size()), 0 } };
+
+    // json objects keep their members sorted by key, so models and materials come out sorted by name as well
+    for (const auto& [model_name, materials] : info.items()) {
+        const u32 model_index = static_cast<u32>(mModels.size());
+        Model model{ AddString(model_name), file_index, { static_cast<u32>(mMaterials.size()), 0 } };
+
+        for (const auto& [material_name, material_info] : materials.items()) {
+            Material material{};
+            material.name = AddString(material_name);
+            material.model = model_index;
+            material.file = file_index;
+            material.static_options = AddValues(material_info.at("Static Options"));
+            material.render_info = AddValues(material_info.at("Render Info"));
+            material.samplers = AddNames(material_info.at("Samplers"));
+            material.textures = AddNames(material_info.at("Textures"));
+
+            const auto& skin_counts = material_info.at("Skin Counts");
+            const auto& program_indices = material_info.at("Shader Indices");
+            material.variants = { static_cast<u32>(mVariants.size()), static_cast<u32>(skin_counts.size()) };
+            for (size_t i = 0; i < skin_counts.size(); ++i)
+                mVariants.push_back({ skin_counts[i].get<u32>(), program_indices.at(i).get<s32>() });
+
+            mMaterials.push_back(material);
+            ++model.materials.count;
+        }
+
+        file.materials.count += model.materials.count;
+        mModels.push_back(model);
+        ++file.models.count;
+    }
+
+    mFiles.push_back(file);
+}
+
+std::vector<u8> MaterialDbBuilder::Build() const {
+    // keep the load factor at or below 50% so probe sequences stay short
+    const u32 string_count = static_cast<u32>(mStringOffsets.size() - 1);
+    const size_t hash_capacity = std::bit_ceil(std::max<size_t>(static_cast<size_t>(string_count) * 2, 16));
+    std::vector<u32> string_hash(hash_capacity, cInvalidId);
+    for (u32 id = 0; id < string_count; ++id) {
+        const std::string_view str(mStringData.data() + mStringOffsets[id], mStringOffsets[id + 1] - mStringOffsets[id]);
+        for (size_t i = material_db::HashString(str) & (hash_capacity - 1);; i = (i + 1) & (hash_capacity - 1)) {
+            if (string_hash[i] == cInvalidId) {
+                string_hash[i] = id;
+                break;
+            }
+        }
+    }
+
+    std::vector<IndexEntry> material_name_index{};
+    std::vector<IndexEntry> program_index{};
+    material_name_index.reserve(mMaterials.size());
+    for (u32 i = 0; i < mMaterials.size(); ++i) {
+        const Material& material = mMaterials[i];
+        material_name_index.push_back({ material.name, i });
+        for (u32 j = 0; j < material.variants.count; ++j) {
+            const s32 program = mVariants[material.variants.first + j].program_index;
+            if (program >= 0)
+                program_index.push_back({ static_cast<u32>(program), i });
+        }
+    }
+
+    const auto by_key = [](const IndexEntry& lhs, const IndexEntry& rhs) { return lhs.key != rhs.key ? lhs.key < rhs.key : lhs.material < rhs.material; };
+    std::sort(material_name_index.begin(), material_name_index.end(), by_key);
+    std::sort(program_index.begin(), program_index.end(), by_key);
+    // a material picking the same program for several skin counts is only listed once
+    program_index.erase(std::unique(program_index.begin(), program_index.end(), [](const IndexEntry& lhs, const IndexEntry& rhs) {
+        return lhs.key == rhs.key && lhs.material == rhs.material;
+    }), program_index.end());
+
+    Header header{};
+    header.signature = cSignature;
+    header.version = cVersion;
+
+    size_t size = sizeof(Header);
+    const auto place = [&size](Section& section, size_t count, size_t element_size) {
+        size = (size + 7) & ~static_cast<size_t>(7);
+        section = { static_cast<u32>(size), static_cast<u32>(count) };
+        size += count * element_size;
+    };
+    place(header.string_offsets, mStringOffsets.size(), sizeof(u32));
+    place(header.string_data, mStringData.size(), sizeof(char));
+    place(header.string_hash, string_hash.size(), sizeof(u32));
+    place(header.files, mFiles.size(), sizeof(File));
+    place(header.models, mModels.size(), sizeof(Model));
+    place(header.materials, mMaterials.size(), sizeof(Material));
+    place(header.values, mValues.size(), sizeof(Value));
+    place(header.names, mNames.size(), sizeof(u32));
+    place(header.variants, mVariants.size(), sizeof(Variant));
+    place(header.material_name_index, material_name_index.size(), sizeof(IndexEntry));
+    place(header.program_index, program_index.size(), sizeof(IndexEntry));
+    size = (size + 7) & ~static_cast<size_t>(7);
+
+    if (size > 0xffffffffull)
+        throw std::runtime_error(std::format("Material database is too large: {:#x} bytes", size));
+    header.file_size = static_cast<u32>(size);
+
+    std::vector<u8> data(size);
+    std::memcpy(data.data(), &header, sizeof(header));
+    const auto copy = [&data](const Section& section, const void* source, size_t element_size) {
+        if (section.count != 0)
+            std::memcpy(data.data() + section.offset, source, section.count * element_size);
+    };
+    copy(header.string_offsets, mStringOffsets.data(), sizeof(u32));
+    copy(header.string_data, mStringData.data(), sizeof(char));
+    copy(header.string_hash, string_hash.data(), sizeof(u32));
+    copy(header.files, mFiles.data(), sizeof(File));
+    copy(header.models, mModels.data(), sizeof(Model));
+    copy(header.materials, mMaterials.data(), sizeof(Material));
+    copy(header.values, mValues.data(), sizeof(Value));
+    copy(header.names, mNames.data(), sizeof(u32));
+    copy(header.variants, mVariants.data(), sizeof(Variant));
+    copy(header.material_name_index, material_name_index.data(), sizeof(IndexEntry));
+    copy(header.program_index, program_index.data(), sizeof(IndexEntry));
+
+    return data;
+}
+
+bool MaterialDb::Open(const std::string& path) {
+    mHeader = nullptr;
+    if (!mFile.Open(path, MappedFile::Access::ReadOnly, MappedFile::Advice::Random))
+        return false;
+
+    const size_t size = mFile.GetSize();
+    const Header* header = reinterpret_cast<const Header*>(mFile.GetData());
+    if (size < sizeof(Header) || header->signature != cSignature || header->version != cVersion || header->file_size > size)
+        return false;
+
+    const auto is_valid = [header](const Section& section, size_t element_size) {
+        return section.offset % 8 == 0 && static_cast<u64>(section.offset) + static_cast<u64>(section.count) * element_size <= header->file_size;
+    };
+    const bool sections_valid = is_valid(header->string_offsets, sizeof(u32)) && header->string_offsets.count != 0
+                             && is_valid(header->string_data, sizeof(char))
+                             && is_valid(header->string_hash, sizeof(u32)) && std::has_single_bit(header->string_hash.count)
+                             && is_valid(header->files, sizeof(File))
+                             && is_valid(header->models, sizeof(Model))
+                             && is_valid(header->materials, sizeof(Material))
+                             && is_valid(header->values, sizeof(Value))
+                             && is_valid(header->names, sizeof(u32))
+                             && is_valid(header->variants, sizeof(Variant))
+                             && is_valid(header->material_name_index, sizeof(IndexEntry))
+                             && is_valid(header->program_index, sizeof(IndexEntry));
+    if (!sections_valid)
+        return false;
+
+    mHeader = header;
+
+    // indices into other tables are used without checks afterwards, so every one of them is checked once here
+    const u32 file_count = header->files.count;
+    const u32 model_count = header->models.count;
+    const u32 material_count = header->materials.count;
+    const auto models = GetModels();
+    const auto materials = GetMaterials();
+    const bool ids_valid = std::ranges::all_of(models, [&](const Model& model) { return model.file < file_count; })
+                        && std::ranges::all_of(materials, [&](const Material& material) { return material.file < file_count && material.model < model_count; })
+                        && std::ranges::all_of(GetSection<IndexEntry>(header->material_name_index), [&](const IndexEntry& entry) { return entry.material < material_count; })
+                        && std::ranges::all_of(GetSection<IndexEntry>(header->program_index), [&](const IndexEntry& entry) { return entry.material < material_count; });
+    if (!ids_valid) {
+        mHeader = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+std::string_view MaterialDb::GetString(u32 id) const {
+    const auto offsets = GetSection<u32>(mHeader->string_offsets);
+    if (id >= offsets.size() - 1 || offsets[id] > offsets[id + 1] || offsets[id + 1] > mHeader->string_data.count)
+        throw std::runtime_error(std::format("Corrupt material database: invalid string {}", id));
+
+    return { reinterpret_cast<const char*>(mFile.GetData() + mHeader->string_data.offset) + offsets[id], offsets[id + 1] - offsets[id] };
+}
+
+u32 MaterialDb::FindString(std::string_view str) const {
+    const auto slots = GetSection<u32>(mHeader->string_hash);
+    const size_t mask = slots.size() - 1;
+    for (size_t i = material_db::HashString(str) & mask, probes = 0; probes < slots.size(); i = (i + 1) & mask, ++probes) {
+        if (slots[i] == cInvalidId)
+            return cInvalidId;
+
+        if (GetString(slots[i]) == str)
+            return slots[i];
+    }
+    return cInvalidId;
+}
+
+const File* MaterialDb::FindFile(std::string_view name) const {
+    const auto files = GetFiles();
+    const auto it = std::lower_bound(files.begin(), files.end(), name, [this](const File& file, std::string_view n) { return GetString(file.name) < n; });
+    return it != files.end() && GetString(it->name) == name ? &*it : nullptr;
+}
+
+const Model* MaterialDb::FindModel(const File& file, std::string_view name) const {
+    const auto models = GetModels(file);
+    const auto it = std::lower_bound(models.begin(), models.end(), name, [this](const Model& model, std::string_view n) { return GetString(model.name) < n; });
+    return it != models.end() && GetString(it->name) == name ? &*it : nullptr;
+}
+
+const Material* MaterialDb::FindMaterial(const Model& model, std::string_view name) const {
+    const auto materials = GetMaterials(model);
+    const auto it = std::lower_bound(materials.begin(), materials.end(), name, [this](const Material& material, std::string_view n) { return GetString(material.name) < n; });
+    return it != materials.end() && GetString(it->name) == name ? &*it : nullptr;
+}
+
+std::span<const IndexEntry> MaterialDb::FindIndexEntries(const Section& section, u32 key) const {
+    const auto entries = GetSection<IndexEntry>(section);
+    const auto [first, last] = std::equal_range(entries.begin(), entries.end(), IndexEntry{ key, 0 }, [](const IndexEntry& lhs, const IndexEntry& rhs) { return lhs.key < rhs.key; });
+    return { first, last };
+}
+
+std::span<const IndexEntry> MaterialDb::FindMaterialsByName(std::string_view name) const {
+    const u32 id = FindString(name);
+    if (id == cInvalidId)
+        return {};
+
+    return FindIndexEntries(mHeader->material_name_index, id);
+}
+
+std::span<const IndexEntry> MaterialDb::FindMaterialsByProgram(s32 program_index) const {
+    if (program_index < 0)
+        return {};
+
+    return FindIndexEntries(mHeader->program_index, static_cast<u32>(program_index));
+}
+
+nlohmann::json MaterialDb::GetValue(const Value& value) const {
+    switch (value.type) {
+        case ValueType::Bool:
+            return value.data != 0;
+        case ValueType::Int:
+            return std::bit_cast<s32>(value.data);
+        case ValueType::Float:
+            return std::bit_cast<f32>(value.data);
+        case ValueType::String:
+            return GetString(value.data);
+    }
+    throw std::runtime_error(std::format("Corrupt material database: invalid value type {}", static_cast<u32>(value.type)));
+}
+
+nlohmann::json MaterialDb::GetInfo(const Material& material) const {
+    nlohmann::json info = {
+        {"Static Options", nlohmann::json::object()},
+        {"Samplers", nlohmann::json::array()},
+        {"Textures", nlohmann::json::array()},
+        {"Render Info", nlohmann::json::object()},
+        {"Skin Counts", nlohmann::json::array()},
+        {"Shader Indices", nlohmann::json::array()},
+    };
+
+    for (const Value& value : GetStaticOptions(material))
+        info["Static Options"][GetString(value.key)] = GetValue(value);
+
+    for (const Value& value : GetRenderInfo(material))
+        info["Render Info"][GetString(value.key)] = GetValue(value);
+
+    for (const u32 name : GetSamplers(material))
+        info["Samplers"].push_back(GetString(name));
+
+    for (const u32 name : GetTextures(material))
+        info["Textures"].push_back(GetString(name));
+
+    for (const Variant& variant : GetVariants(material)) {
+        info["Skin Counts"].push_back(variant.skin_count);
+        info["Shader Indices"].push_back(variant.program_index);
+    }
+
+    return info;
+}
\ No newline at end of file
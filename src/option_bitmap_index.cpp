@@ -0,0 +1,64 @@
+#include "option_bitmap_index.h"
+
+#include <algorithm>
+#include <bit>
+
+void OptionBitmapIndex::Build(const KeyTableColumns& columns) {
+    mRowCount = columns.GetRowCount();
+    mWordCount = (static_cast<size_t>(mRowCount) + 63) / 64;
+    mStaticOptionCount = columns.GetStaticOptionCount();
+
+    const u32 option_count = columns.GetOptionCount();
+    mOptionOffsets.resize(option_count + 1);
+    mOptionOffsets[0] = 0;
+    for (u32 i = 0; i < option_count; ++i)
+        mOptionOffsets[i + 1] = mOptionOffsets[i] + columns.GetOption(i)->choice_count;
+
+    mBits.assign(static_cast<size_t>(mOptionOffsets[option_count]) * mWordCount, 0);
+
+    // one column at a time so the reads are sequential and every write lands in the same few bitsets
+    for (u32 i = 0; i < option_count; ++i) {
+        const u32 choice_count = GetChoiceCount(i);
+        u64* bits = mBits.data() + static_cast<size_t>(mOptionOffsets[i]) * mWordCount;
+
+        columns.Get(i).Visit([&](const auto column) {
+            for (u32 row = 0; row < mRowCount; ++row) {
+                const u32 choice = column[row];
+                if (choice < choice_count)
+                    bits[choice * mWordCount + row / 64] |= 1ull << (row % 64);
+            }
+        });
+    }
+}
+
+void OptionBitmapIndex::Select(std::span<const Term> terms, std::vector<u64>& out_matches) const {
+    out_matches.assign(mWordCount, ~0ull);
+    if (mRowCount % 64 != 0)
+        out_matches.back() = (1ull << (mRowCount % 64)) - 1;
+
+    for (const auto& term : terms) {
+        u64 any = 0;
+        for (size_t w = 0; w < mWordCount; ++w) {
+            if (out_matches[w] == 0)
+                continue;
+
+            u64 allowed = 0;
+            for (const u32 choice : term.choices) {
+                if (choice < GetChoiceCount(term.option_slot))
+                    allowed |= Get(term.option_slot, choice)[w];
+            }
+            out_matches[w] &= allowed;
+            any |= out_matches[w];
+        }
+
+        if (any == 0)
+            break;
+    }
+}
+
+size_t OptionBitmapIndex::Count(std::span<const u64> bits) {
+    size_t count = 0;
+    for (const u64 word : bits)
+        count += std::popcount(word);
+    return count;
+}
\ No newline at end of file
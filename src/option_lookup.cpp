@@ -0,0 +1,88 @@
+#include "option_lookup.h"
+
+#include <algorithm>
+#include <bit>
+
+u64 OptionLookup::HashSymbol(Symbol symbol, u32 seed) {
+    u64 hash = (static_cast<u64>(seed) << 32 | symbol) * 0x9e3779b97f4a7c15ull;
+    hash ^= hash >> 32;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void OptionLookup::Build(const g3d2::ResShadingModel* model) {
+    mModel = model;
+    mOptionCount = model->static_option_count + model->dynamic_option_count;
+
+    u32 choice_count = 0;
+    for (u32 slot = 0; slot < mOptionCount; ++slot)
+        choice_count += GetOption(slot)->choice_count;
+
+    // keep the load factor at or below 50% so probe sequences stay short
+    const size_t option_capacity = std::bit_ceil(std::max<size_t>(static_cast<size_t>(mOptionCount) * 2, 16));
+    mOptionSlots.assign(option_capacity, { SymbolTable::cInvalidSymbol, { cEmptySlot, cEmptySlot } });
+    mOptionMask = static_cast<u32>(option_capacity - 1);
+
+    const size_t choice_capacity = std::bit_ceil(std::max<size_t>(static_cast<size_t>(choice_count) * 2, 16));
+    mChoiceSlots.assign(choice_capacity, { SymbolTable::cInvalidSymbol, 0, cEmptySlot });
+    mChoiceMask = static_cast<u32>(choice_capacity - 1);
+
+    for (u32 slot = 0; slot < mOptionCount; ++slot) {
+        const g3d2::ResShaderOption* option = GetOption(slot);
+
+        // names are unique within each of the model's option dicts, but one can be in both, so each entry keeps a slot for either dict
+        const Symbol name = SymbolTable::Intern(option->name->Get());
+        for (u32 i = static_cast<u32>(HashSymbol(name)) & mOptionMask;; i = (i + 1) & mOptionMask) {
+            auto& entry = mOptionSlots[i];
+            if (entry.slots.static_slot == cEmptySlot && entry.slots.dynamic_slot == cEmptySlot)
+                entry.name = name;
+            if (entry.name != name)
+                continue;
+
+            (IsDynamic(slot) ? entry.slots.dynamic_slot : entry.slots.static_slot) = static_cast<s32>(slot);
+            break;
+        }
+
+        for (u32 choice = 0; choice < option->choice_count; ++choice) {
+            const Symbol value = SymbolTable::Intern(option->choice_dict->entries[choice + 1].key->Get());
+            for (u32 i = static_cast<u32>(HashSymbol(value, slot + 1)) & mChoiceMask;; i = (i + 1) & mChoiceMask) {
+                auto& entry = mChoiceSlots[i];
+                if (entry.choice == cEmptySlot) {
+                    entry = { value, slot, static_cast<s32>(choice) };
+                    break;
+                }
+                if (entry.name == value && entry.option == slot)
+                    break;
+            }
+        }
+    }
+}
+
+OptionLookup::OptionSlots OptionLookup::FindOptions(Symbol name) const {
+    if (mOptionSlots.empty() || name == SymbolTable::cInvalidSymbol)
+        return {};
+
+    for (u32 i = static_cast<u32>(HashSymbol(name)) & mOptionMask;; i = (i + 1) & mOptionMask) {
+        const auto& entry = mOptionSlots[i];
+        if (entry.slots.static_slot == cEmptySlot && entry.slots.dynamic_slot == cEmptySlot)
+            return {};
+
+        if (entry.name == name)
+            return entry.slots;
+    }
+}
+
+s32 OptionLookup::FindChoice(u32 slot, Symbol value) const {
+    if (mChoiceSlots.empty() || slot >= mOptionCount || value == SymbolTable::cInvalidSymbol)
+        return -1;
+
+    for (u32 i = static_cast<u32>(HashSymbol(value, slot + 1)) & mChoiceMask;; i = (i + 1) & mChoiceMask) {
+        const auto& entry = mChoiceSlots[i];
+        if (entry.choice == cEmptySlot)
+            return -1;
+
+        if (entry.name == value && entry.option == slot)
+            return entry.choice;
+    }
+}
\ No newline at end of file
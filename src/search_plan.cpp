@@ -0,0 +1,154 @@
+#include "search_plan.h"
+
+#include <algorithm>
+#include <bit>
+#include <format>
+
+static std::string_view GetStrategyName(SearchPlan::Strategy strategy) {
+    switch (strategy) {
+        case SearchPlan::Strategy::Empty: return "none (no program can match)";
+        case SearchPlan::Strategy::Scan: return "key table scan";
+        case SearchPlan::Strategy::Bitmaps: return "option bitmaps";
+        default: return "unknown";
+    }
+}
+
+SearchPlan::SearchPlan(const ShaderArchive& archive, const g3d2::ResShadingModel* model, std::span<const Term> terms)
+    : mArchive(archive), mModel(model) {
+    const KeyTableColumns& columns = archive.GetColumns(model);
+    const u32 row_count = model->shader_program_count;
+
+    for (const auto& term : terms) {
+        Step step{};
+        step.term = &term;
+        step.option_slot = term.is_dynamic ? columns.GetDynamicSlot(static_cast<u32>(term.option - model->dynamic_option_array))
+                                           : columns.GetStaticSlot(static_cast<u32>(term.option - model->static_option_array));
+
+        // the same choice may be listed more than once
+        std::vector<u32> choices = term.choices;
+        std::sort(choices.begin(), choices.end());
+        choices.erase(std::unique(choices.begin(), choices.end()), choices.end());
+
+        const auto histogram = columns.Get(step.option_slot).GetHistogram();
+        for (const u32 choice : choices) {
+            if (choice < histogram.size())
+                step.passing_count += histogram[choice];
+        }
+
+        if (step.passing_count == row_count) {
+            mDroppedSteps.push_back(step);
+        } else {
+            mSteps.push_back(step);
+        }
+    }
+
+    std::stable_sort(mSteps.begin(), mSteps.end(), [](const Step& a, const Step& b) { return a.passing_count < b.passing_count; });
+
+    if (!mSteps.empty() && mSteps.front().passing_count == 0) {
+        mStrategy = Strategy::Empty;
+    } else if (row_count >= ShaderArchive::cOptionBitmapMinPrograms) {
+        mStrategy = Strategy::Bitmaps;
+    } else {
+        mStrategy = Strategy::Scan;
+    }
+}
+
+f64 SearchPlan::GetSelectivity(const Step& step) const {
+    return mModel->shader_program_count == 0 ? 0.0 : static_cast<f64>(step.passing_count) / mModel->shader_program_count;
+}
+
+void SearchPlan::Execute(std::vector<u64>& out_matches) const {
+    const u32 row_count = mModel->shader_program_count;
+
+    switch (mStrategy) {
+        case Strategy::Empty:
+            out_matches.assign((row_count + 63) / 64, 0);
+            break;
+        case Strategy::Bitmaps: {
+            std::vector<OptionBitmapIndex::Term> terms{};
+            for (const auto& step : mSteps) {
+                terms.push_back({ step.option_slot, step.term->choices });
+            }
+            mArchive.GetOptionBitmaps(mModel).Select(terms, out_matches);
+            break;
+        }
+        case Strategy::Scan: {
+            std::vector<key_scan::Clause> clauses{};
+            for (const auto& step : mSteps) {
+                const auto* option = step.term->option;
+                key_scan::Clause clause{};
+                clause.word = step.term->is_dynamic ? mModel->static_key_count + option->option_index - option->dynamic_index_offset : option->option_index;
+                clause.mask = option->option_mask;
+                for (const u32 choice : step.term->choices) {
+                    clause.values.push_back((choice << option->bit_offset) & option->option_mask);
+                }
+                clause.selectivity = static_cast<f32>(GetSelectivity(step));
+                clauses.push_back(std::move(clause));
+            }
+            key_scan::Run(key_scan::Compile(clauses), mModel->key_table, row_count, mModel->static_key_count + mModel->dynamic_key_count, out_matches);
+            break;
+        }
+    }
+}
+
+void SearchPlan::Describe(std::ostream& stream, const Step& step) const {
+    const auto* option = step.term->option;
+    stream << std::format("{} {} in [", step.term->is_dynamic ? "dynamic" : "static", option->name->Get());
+    for (size_t i = 0; i < step.term->choices.size(); ++i) {
+        const u32 choice = step.term->choices[i];
+        stream << (i == 0 ? "" : ", ") << (choice < option->choice_count ? option->choice_dict->entries[choice + 1].key->Get() : "?");
+    }
+    stream << std::format("] ({} programs, {:.2f}%)", step.passing_count, GetSelectivity(step) * 100.0);
+}
+
+void SearchPlan::Explain(std::ostream& stream) const {
+    const u32 row_count = mModel->shader_program_count;
+    const KeyTableColumns& columns = mArchive.GetColumns(mModel);
+
+    stream << std::format("Plan for {} ({} programs): {}\n", mModel->name->Get(), row_count, GetStrategyName(mStrategy));
+
+    // steps are applied to a running bitset using the decoded columns, which gives exact counts whatever the strategy
+    std::vector<u64> remaining((row_count + 63) / 64, ~0ull);
+    if (row_count % 64 != 0)
+        remaining.back() = (1ull << (row_count % 64)) - 1;
+    size_t remaining_count = row_count;
+
+    for (size_t i = 0; i < mSteps.size(); ++i) {
+        const Step& step = mSteps[i];
+        const auto& column = columns.Get(step.option_slot);
+        std::vector<bool> allowed(step.term->option->choice_count, false);
+        for (const u32 choice : step.term->choices) {
+            if (choice < allowed.size())
+                allowed[choice] = true;
+        }
+
+        size_t count = 0;
+        for (size_t w = 0; w < remaining.size(); ++w) {
+            for (u64 bits = remaining[w]; bits != 0; bits &= bits - 1) {
+                const size_t row = w * 64 + std::countr_zero(bits);
+                const u32 choice = column[row];
+                if (choice >= allowed.size() || !allowed[choice])
+                    remaining[w] &= ~(1ull << (row % 64));
+            }
+            count += std::popcount(remaining[w]);
+        }
+
+        stream << std::format("  {}. ", i + 1);
+        Describe(stream, step);
+        stream << std::format(": {} -> {} (-{})\n", remaining_count, count, remaining_count - count);
+        remaining_count = count;
+
+        if (remaining_count == 0 && i + 1 < mSteps.size()) {
+            stream << std::format("  stopped, no programs left for the remaining {} step(s)\n", mSteps.size() - i - 1);
+            break;
+        }
+    }
+
+    for (const auto& step : mDroppedSteps) {
+        stream << "  skipped ";
+        Describe(stream, step);
+        stream << ": every program passes\n";
+    }
+
+    stream << std::format("  {} matching program(s)\n", remaining_count);
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "selection_cache.h"
+
+#include <algorithm>
+
+u64 SelectionCache::HashOptions(const ShaderSelector& selector) {
+    const auto mix = [](u64 hash, u64 value) {
+        hash ^= value;
+        hash *= 0xff51afd7ed558ccdull;
+        return hash ^ (hash >> 32);
+    };
+
+    u64 hash = mix(0x9e3779b97f4a7c15ull, static_cast<u64>(selector.GetArchiveName()) << 32 | selector.GetModelName());
+    for (const auto& [key, value] : selector.GetOptions())
+        hash = mix(hash, static_cast<u64>(key) << 32 | value);
+
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool SelectionCache::Matches(const Entry& entry, const ShaderSelector& selector) {
+    const auto& options = selector.GetOptions();
+    return entry.archive_name == selector.GetArchiveName() && entry.model_name == selector.GetModelName()
+           && std::equal(entry.options.begin(), entry.options.end(), options.begin(), options.end(), [](const SymbolMap::Entry& lhs, const SymbolMap::Entry& rhs) {
+                  return lhs.key == rhs.key && lhs.value == rhs.value;
+              });
+}
+
+const SelectionCache::Result& SelectionCache::SearchVariants(ShaderSelector& selector, const ShaderArchive& archive) {
+    const u64 hash = HashOptions(selector);
+    Shard& shard = mShards[hash % cShardCount];
+
+    {
+        std::lock_guard lock(shard.mutex);
+        const auto [begin, end] = shard.entries.equal_range(hash);
+        for (auto it = begin; it != end; ++it) {
+            if (Matches(it->second, selector)) {
+                ++mHitCount;
+                return it->second.result;
+            }
+        }
+    }
+
+    // searched outside the lock, if another thread got to the same options first its result is kept and this one is dropped
+    ++mMissCount;
+    Result result = selector.SearchVariants(archive, mOptionName, mValues);
+
+    std::lock_guard lock(shard.mutex);
+    const auto [begin, end] = shard.entries.equal_range(hash);
+    for (auto it = begin; it != end; ++it) {
+        if (Matches(it->second, selector))
+            return it->second.result;
+    }
+
+    const auto& options = selector.GetOptions();
+    Entry entry{ selector.GetArchiveName(), selector.GetModelName(), std::vector<SymbolMap::Entry>(options.begin(), options.end()), std::move(result) };
+    return shard.entries.emplace(hash, std::move(entry))->second.result;
+}
+
+size_t SelectionCache::GetEntryCount() const {
+    size_t count = 0;
+    for (const auto& shard : mShards) {
+        std::lock_guard lock(shard.mutex);
+        count += shard.entries.size();
+    }
+    return count;
+}
\ No newline at end of file
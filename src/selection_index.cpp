@@ -0,0 +1,260 @@
+#include "selection_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+namespace selection_index {
+
+constexpr u64 cFingerprintPrime = 0x9e3779b97f4a7c15ull;
+
+static u64 MixWord(u64 hash, u64 word) {
+    return (hash ^ word) * cFingerprintPrime;
+}
+
+u64 ComputeFingerprint(std::span<const u8> data) {
+    // every byte is hashed, 32 bytes at a time over four independent lanes so the multiplies overlap
+    // each step is a bijection of the lane, so changing any single word always changes the fingerprint
+    u64 lanes[4] = { 0xcbf29ce484222325ull, 0x84222325cbf29ce4ull, 0x100000001b3ull, data.size() };
+
+    size_t offset = 0;
+    for (; offset + sizeof(lanes) <= data.size(); offset += sizeof(lanes)) {
+        u64 words[4];
+        std::memcpy(words, data.data() + offset, sizeof(words));
+        for (size_t i = 0; i < 4; ++i)
+            lanes[i] = MixWord(lanes[i], words[i]);
+    }
+
+    for (size_t lane = 0; offset < data.size(); offset += sizeof(u64), ++lane) {
+        u64 word = 0;
+        std::memcpy(&word, data.data() + offset, std::min(sizeof(u64), data.size() - offset));
+        lanes[lane] = MixWord(lanes[lane], word);
+    }
+
+    u64 hash = data.size();
+    for (const u64 lane : lanes) {
+        hash = MixWord(hash, lane);
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+// writes structures into a growing buffer, pointer fields are written as file offsets and recorded for the relocation table
+class IndexWriter {
+public:
+    size_t Allocate(size_t size, size_t alignment) {
+        const size_t offset = (mBuffer.size() + alignment - 1) & ~(alignment - 1);
+        mBuffer.resize(offset + size);
+        return offset;
+    }
+
+    template <typename T>
+    size_t Allocate(size_t count = 1) {
+        return Allocate(sizeof(T) * count, alignof(T));
+    }
+
+    // only valid until the next allocation
+    template <typename T>
+    T* At(size_t offset) {
+        return reinterpret_cast<T*>(mBuffer.data() + offset);
+    }
+
+    void SetPointer(size_t position, size_t target) {
+        if (target == 0)
+            return;
+
+        std::memcpy(mBuffer.data() + position, &target, sizeof(u64));
+        mPointers.push_back(position);
+    }
+
+    template <typename T, typename U>
+    void SetPointer(size_t offset, U* T::* member, size_t target) {
+        T* data = At<T>(offset);
+        const size_t field_offset = reinterpret_cast<uintptr_t>(&(data->*member)) - reinterpret_cast<uintptr_t>(data);
+        SetPointer(offset + field_offset, target);
+    }
+
+    size_t WriteString(const std::string_view value) {
+        if (const auto it = mStrings.find(std::string(value)); it != mStrings.end())
+            return it->second;
+
+        const size_t offset = Allocate(sizeof(u16) + value.size() + 1, 4);
+        const u16 length = static_cast<u16>(value.size());
+        std::memcpy(mBuffer.data() + offset, &length, sizeof(length));
+        std::memcpy(mBuffer.data() + offset + sizeof(u16), value.data(), value.size());
+        mStrings.emplace(value, offset);
+        return offset;
+    }
+
+    template <typename T>
+    size_t WriteArray(const T* data, size_t count) {
+        if (data == nullptr || count == 0)
+            return 0;
+
+        const size_t offset = Allocate<T>(count);
+        std::memcpy(mBuffer.data() + offset, data, sizeof(T) * count);
+        return offset;
+    }
+
+    size_t WriteDic(const ResDicView& dic) {
+        if (!dic)
+            return 0;
+
+        const size_t entry_count = dic->node_count + 1;
+        const size_t offset = Allocate(offsetof(ResDic, entries) + sizeof(ResDic::Entry) * entry_count, alignof(ResDic));
+        {
+            ResDic* dst = At<ResDic>(offset);
+            dst->signature = dic->signature;
+            dst->node_count = dic->node_count;
+        }
+
+        for (size_t i = 0; i < entry_count; ++i) {
+            const ResView<ResDic::Entry> entry(dic.GetBase(), &dic->entries[i]);
+            {
+                ResDic::Entry* dst = &At<ResDic>(offset)->entries[i];
+                dst->ref_bit = entry->ref_bit;
+                dst->children[0] = entry->children[0];
+                dst->children[1] = entry->children[1];
+            }
+
+            const auto key = entry.Get(&ResDic::Entry::key);
+            if (key) {
+                const size_t key_offset = WriteString(key.GetString());
+                SetPointer(offset + offsetof(ResDic, entries) + sizeof(ResDic::Entry) * i + offsetof(ResDic::Entry, key), key_offset);
+            }
+        }
+
+        return offset;
+    }
+
+    // appends a relocation table covering every pointer written and returns the finished file
+    std::vector<u8> Finish() {
+        std::sort(mPointers.begin(), mPointers.end());
+
+        // merge adjacent pointers into runs
+        std::vector<RelocationTable::Entry> entries{};
+        for (const size_t position : mPointers) {
+            if (!entries.empty()) {
+                auto& last = entries.back();
+                if (last.position + last.relocation_count * sizeof(u64) == position && last.relocation_count < 0xff) {
+                    ++last.relocation_count;
+                    continue;
+                }
+            }
+            entries.push_back({ static_cast<u32>(position), 1, 1, 0 });
+        }
+
+        const size_t data_size = mBuffer.size();
+        const size_t table_offset = Allocate(offsetof(RelocationTable, sections) + sizeof(RelocationTable::Section) + sizeof(RelocationTable::Entry) * entries.size(), 8);
+        {
+            RelocationTable* table = At<RelocationTable>(table_offset);
+            table->signature._packed = 0x544c525f; // _RLT
+            table->this_offset = static_cast<u32>(table_offset);
+            table->section_count = 1;
+            table->sections[0].offset = 0;
+            table->sections[0].position = 0;
+            table->sections[0].size = static_cast<u32>(data_size);
+            table->sections[0].base_entry_index = 0;
+            table->sections[0].entry_count = static_cast<s32>(entries.size());
+            std::memcpy(const_cast<RelocationTable::Entry*>(table->GetEntry(0)), entries.data(), sizeof(RelocationTable::Entry) * entries.size());
+        }
+
+        BinaryFileHeader* header = At<BinaryFileHeader>(0);
+        header->rel_table_offset = static_cast<u32>(table_offset);
+        header->file_size = static_cast<u32>(mBuffer.size());
+
+        return std::move(mBuffer);
+    }
+
+private:
+    std::vector<u8> mBuffer{};
+    std::vector<size_t> mPointers{};
+    std::unordered_map<std::string, size_t> mStrings{};
+};
+
+static size_t WriteOptions(IndexWriter& writer, const ResShaderOptionView& options, size_t count) {
+    if (!options || count == 0)
+        return 0;
+
+    const size_t offset = writer.Allocate<g3d2::ResShaderOption>(count);
+    for (size_t i = 0; i < count; ++i) {
+        const auto option = options[i];
+        const size_t dst = offset + sizeof(g3d2::ResShaderOption) * i;
+        {
+            auto* data = writer.At<g3d2::ResShaderOption>(dst);
+            data->choice_count = option->choice_count;
+            data->default_choice = option->default_choice;
+            data->_1c = option->_1c;
+            data->use_block_buffer = option->use_block_buffer;
+            data->dynamic_index_offset = option->dynamic_index_offset;
+            data->option_mask = option->option_mask;
+            data->option_index = option->option_index;
+            data->bit_offset = option->bit_offset;
+        }
+
+        writer.SetPointer(dst, &g3d2::ResShaderOption::name, writer.WriteString(option.GetString(&g3d2::ResShaderOption::name)));
+        writer.SetPointer(dst, &g3d2::ResShaderOption::choice_dict, writer.WriteDic(option.Get(&g3d2::ResShaderOption::choice_dict)));
+        writer.SetPointer(dst, &g3d2::ResShaderOption::choice_array, writer.WriteArray(option.Get(&g3d2::ResShaderOption::choice_array).GetData(), option->choice_count));
+    }
+
+    return offset;
+}
+
+static void WriteModel(IndexWriter& writer, const ResShadingModelView& model, size_t offset, size_t archive_offset) {
+    {
+        auto* data = writer.At<g3d2::ResShadingModel>(offset);
+        data->default_key_index = model->default_key_index;
+        data->static_option_count = model->static_option_count;
+        data->dynamic_option_count = model->dynamic_option_count;
+        data->shader_program_count = model->shader_program_count;
+        data->static_key_count = model->static_key_count;
+        data->dynamic_key_count = model->dynamic_key_count;
+    }
+
+    const size_t key_count = static_cast<size_t>(model->static_key_count + model->dynamic_key_count) * model->shader_program_count;
+
+    writer.SetPointer(offset, &g3d2::ResShadingModel::name, writer.WriteString(model.GetString(&g3d2::ResShadingModel::name)));
+    writer.SetPointer(offset, &g3d2::ResShadingModel::parent_archive, archive_offset);
+    writer.SetPointer(offset, &g3d2::ResShadingModel::static_option_array, WriteOptions(writer, model.Get(&g3d2::ResShadingModel::static_option_array), model->static_option_count));
+    writer.SetPointer(offset, &g3d2::ResShadingModel::static_option_dict, writer.WriteDic(model.Get(&g3d2::ResShadingModel::static_option_dict)));
+    writer.SetPointer(offset, &g3d2::ResShadingModel::dynamic_option_array, WriteOptions(writer, model.Get(&g3d2::ResShadingModel::dynamic_option_array), model->dynamic_option_count));
+    writer.SetPointer(offset, &g3d2::ResShadingModel::dynamic_option_dict, writer.WriteDic(model.Get(&g3d2::ResShadingModel::dynamic_option_dict)));
+    writer.SetPointer(offset, &g3d2::ResShadingModel::key_table, writer.WriteArray(model.Get(&g3d2::ResShadingModel::key_table).GetData(), key_count));
+}
+
+std::vector<u8> Build(const ResShaderFileView& file, u64 source_fingerprint, u64 source_size) {
+    IndexWriter writer{};
+
+    const size_t header_offset = writer.Allocate<ResSelectionIndexFile>();
+    {
+        auto* header = writer.At<ResSelectionIndexFile>(header_offset);
+        header->signature._packed = cSignature;
+        header->version = { cVersionMicro, cVersionMinor, cVersionMajor };
+        header->bom = 0xfeff;
+        header->alignment_shift = 3;
+        header->address_size = 0;
+        header->source_fingerprint = source_fingerprint;
+        header->source_size = source_size;
+    }
+
+    const auto archive = file.Get(&g3d2::ResShaderFile::archive);
+    const size_t model_count = archive->shading_model_count;
+
+    const size_t archive_offset = writer.Allocate<g3d2::ResShaderArchive>();
+    writer.At<g3d2::ResShaderArchive>(archive_offset)->shading_model_count = static_cast<u16>(model_count);
+    writer.SetPointer(header_offset, &g3d2::ResShaderFile::archive, archive_offset);
+
+    const size_t models_offset = writer.Allocate<g3d2::ResShadingModel>(model_count);
+    const auto models = archive.Get(&g3d2::ResShaderArchive::shading_model_array);
+    for (size_t i = 0; i < model_count; ++i)
+        WriteModel(writer, models[i], models_offset + sizeof(g3d2::ResShadingModel) * i, archive_offset);
+
+    writer.SetPointer(archive_offset, &g3d2::ResShaderArchive::name, writer.WriteString(archive.GetString(&g3d2::ResShaderArchive::name)));
+    writer.SetPointer(archive_offset, &g3d2::ResShaderArchive::shading_model_array, models_offset);
+    writer.SetPointer(archive_offset, &g3d2::ResShaderArchive::shading_model_dict, writer.WriteDic(archive.Get(&g3d2::ResShaderArchive::shading_model_dict)));
+
+    return writer.Finish();
+}
+
+} // namespace selection_index
\ No newline at end of file
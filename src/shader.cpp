@@ -1,8 +1,10 @@
 #include "shader.h"
 
+#include <algorithm>
 #include <array>
 #include <cstring>
 #include <format>
+#include <iterator>
 #include <string>
 
 // the game searches from 0 to 17 even though most shaders definitely do not support that range or even accept this range as valid choices
@@ -38,22 +40,22 @@ const std::string ShaderSelector::cFalse = "0";
 const std::string ShaderSelector::cWeightName = "gsys_weight";
 
 void ShaderSelector::LoadOptions(const ResMaterial* material) {
-    mArchiveName = material->shader_data->shader_reflection->archive_name->Get();
-    mModelName = material->shader_data->shader_reflection->shading_model_name->Get();
+    mArchiveName = SymbolTable::Intern(material->shader_data->shader_reflection->archive_name->Get());
+    mModelName = SymbolTable::Intern(material->shader_data->shader_reflection->shading_model_name->Get());
 
     for (size_t i = 0; i < material->shader_data->total_static_option_count; ++i) {
         const u16 index = material->shader_data->static_option_index_array ? material->shader_data->static_option_index_array[i] : static_cast<u16>(i);
         const std::string_view& key = material->shader_data->shader_reflection->static_option_dict->entries[index + 1].key->Get();
 
         if (i < material->shader_data->bool_static_option_count) {
-            mOptions.emplace(
-                key,
-                (material->shader_data->static_option_bool_value_array[i >> 5 & 0x7ffffff] >> (i & 0x1f) & 1) ? cTrue : cFalse
+            mOptions.Emplace(
+                SymbolTable::Intern(key),
+                SymbolTable::Intern((material->shader_data->static_option_bool_value_array[i >> 5 & 0x7ffffff] >> (i & 0x1f) & 1) ? cTrue : cFalse)
             );
         } else {
-            mOptions.emplace(
-                key,
-                material->shader_data->static_option_string_array[i - material->shader_data->bool_static_option_count]->Get()
+            mOptions.Emplace(
+                SymbolTable::Intern(key),
+                SymbolTable::Intern(material->shader_data->static_option_string_array[i - material->shader_data->bool_static_option_count]->Get())
             );
         }
     }
@@ -65,15 +67,15 @@ void ShaderSelector::LoadOptions(const ResMaterial* material) {
 
         // just assume they're all strings bc the only values we care about are strings
         if (render_info_name == "gsys_render_state_mode") {
-            mOptions.emplace(cRenderStateName, cNumberNames.at(GetRenderState(value->Get())));
+            mOptions.Emplace(SymbolTable::Intern(cRenderStateName), SymbolTable::Intern(cNumberNames.at(GetRenderState(value->Get()))));
         } else if (render_info_name == "gsys_alpha_test_func") {
-            mOptions.emplace(cAlphaTestFuncName, cNumberNames.at(GetCompareFunc(value->Get())));
+            mOptions.Emplace(SymbolTable::Intern(cAlphaTestFuncName), SymbolTable::Intern(cNumberNames.at(GetCompareFunc(value->Get()))));
         } else if (render_info_name == "gsys_alpha_test_enable") {
-            mOptions.emplace(cAlphaTestEnableName, value->Get() == "true" ? cTrue : cFalse);
+            mOptions.Emplace(SymbolTable::Intern(cAlphaTestEnableName), SymbolTable::Intern(value->Get() == "true" ? cTrue : cFalse));
         } else if (render_info_name == "gsys_render_state_display_face") {
-            mOptions.emplace(cDisplayFaceTypeName, cNumberNames.at(GetDisplayFace(value->Get())));
+            mOptions.Emplace(SymbolTable::Intern(cDisplayFaceTypeName), SymbolTable::Intern(cNumberNames.at(GetDisplayFace(value->Get()))));
         } else if (render_info_name == "gsys_pass") {
-            mOptions.emplace(cPassName, cNumberNames.at(GetPass(value->Get())));
+            mOptions.Emplace(SymbolTable::Intern(cPassName), SymbolTable::Intern(cNumberNames.at(GetPass(value->Get()))));
         } /*else if (render_info_name == "gsys_override_shader") {
             // don't actually add this to the shader options
             // mIsOverride = *value->Get() == "true";
@@ -83,23 +85,43 @@ void ShaderSelector::LoadOptions(const ResMaterial* material) {
         }
     }
 
-    mOptions.emplace("gsys_assign_type", "gsys_assign_material");
+    mOptions.Emplace(SymbolTable::Intern("gsys_assign_type"), SymbolTable::Intern("gsys_assign_material"));
 }
 
-void ShaderSelector::LoadOptions(const json& options) {
-    mArchiveName = options.value("Archive Name", "material");
-    mModelName = options.value("Model Name", "material");
+void ShaderSelector::LoadOptions(const json& options, const ShaderArchive& archive) {
+    // request strings are only looked up, never interned, so a long running server's symbol table can't be grown by whatever clients
+    // send; names the archive doesn't know couldn't select anything anyways and are left out
+    const std::string archive_name = options.value("Archive Name", "material");
+    mArchiveName = archive_name == archive.GetName() ? SymbolTable::Intern(archive.GetName()) : SymbolTable::cInvalidSymbol;
+
+    const g3d2::ResShadingModel* model = archive.FindModel(options.value("Model Name", "material"));
+    if (model == nullptr) {
+        mModelName = SymbolTable::cInvalidSymbol;
+        return;
+    }
+    mModelName = SymbolTable::Intern(model->name->Get());
+
+    // building the lookup interns every option and choice name of the model
+    archive.GetOptionLookup(model);
+
+    const auto emplace_known = [this](std::string_view key, std::string_view value) {
+        const Symbol key_symbol = SymbolTable::Find(key);
+        const Symbol value_symbol = SymbolTable::Find(value);
+        if (key_symbol != SymbolTable::cInvalidSymbol && value_symbol != SymbolTable::cInvalidSymbol) {
+            mOptions.Emplace(key_symbol, value_symbol);
+        }
+    };
 
     const auto& static_options = options.value("Static Options", json({}));
     for (const auto& [key, val] : static_options.items()) {
         if (val.is_boolean()) {
-            mOptions.emplace(key, val.get<bool>() ? cTrue : cFalse);
+            emplace_known(key, val.get<bool>() ? cTrue : cFalse);
         } else {
-            mOptions.emplace(key, val.get<std::string>());
+            emplace_known(key, val.get<std::string>());
         }
     }
 
-    mOptions.emplace("gsys_assign_type", options.value("Assign Type", "gsys_assign_material"));
+    emplace_known("gsys_assign_type", options.value("Assign Type", "gsys_assign_material"));
 }
 
 void ShaderSelector::WriteStaticKey(const g3d2::ResShaderOption* option, u32 value) {
@@ -119,31 +141,26 @@ u32 ShaderSelector::GetDynamicKeyValue(const g3d2::ResShaderOption* option) cons
     return (mKeys[mStaticKeyCount + option->option_index - option->dynamic_index_offset] & option->option_mask) >> option->bit_offset;
 }
 
-void ShaderSelector::WriteKeys(const g3d2::ResShadingModel* model) {
+void ShaderSelector::WriteKeys(const ShaderArchive& archive, const g3d2::ResShadingModel* model) {
     WriteDefaultKeys(model);
 
-    for (size_t i = 0; i < model->static_option_count; ++i) {
-        const auto& option = model->static_option_array[i];
-        if (!mOptions.contains(std::string(option.name->Get())))
-            continue;
-
-        const int index = option.choice_dict->FindIndex(mOptions.at(std::string(option.name->Get())));
-        if (index == -1)
-            continue;
+    // only the options the material actually sets need resolving, the rest keep their defaults
+    const OptionLookup& lookup = archive.GetOptionLookup(model);
+    for (const auto& [key, value] : mOptions) {
+        // an option in both the static and the dynamic dict sets both keys
+        const OptionLookup::OptionSlots slots = lookup.FindOptions(key);
 
-        WriteStaticKey(&option, index);
-    }
-
-    for (size_t i = 0; i < model->dynamic_option_count; ++i) {
-        const auto& option = model->dynamic_option_array[i];
-        if (!mOptions.contains(std::string(option.name->Get())))
-            continue;
-        
-        const int index = option.choice_dict->FindIndex(mOptions.at(std::string(option.name->Get())));
-        if (index == -1)
-            continue;
+        if (slots.static_slot != -1) {
+            const s32 index = lookup.FindChoice(static_cast<u32>(slots.static_slot), value);
+            if (index != -1)
+                WriteStaticKey(lookup.GetOption(static_cast<u32>(slots.static_slot)), index);
+        }
 
-        WriteDynamicKey(&option, index);
+        if (slots.dynamic_slot != -1) {
+            const s32 index = lookup.FindChoice(static_cast<u32>(slots.dynamic_slot), value);
+            if (index != -1)
+                WriteDynamicKey(lookup.GetOption(static_cast<u32>(slots.dynamic_slot)), index);
+        }
     }
 }
 
@@ -166,31 +183,88 @@ void ShaderSelector::WriteDefaultKeys(const g3d2::ResShadingModel* model) {
     }
 }
 
-const g3d2::ResShaderProgram* ShaderSelector::Search(const g3d2::ResShaderFile* shader_file) {
-    if (shader_file->archive->name->Get() != mArchiveName) {
-        return nullptr;
+s32 ShaderSelector::Search(const ShaderArchive& archive) {
+    if (archive.GetName() != SymbolTable::GetString(mArchiveName)) {
+        return -1;
     }
     
-    const g3d2::ResShadingModel* model = nullptr;
-    const std::string_view model_name = /* mIsOverride ? std::format("{}_override", mModelName) : */ mModelName;
-    for (size_t i = 0; i < shader_file->archive->shading_model_count; ++i) {
-        if (shader_file->archive->shading_model_array[i].name->Get() == model_name) {
-            model = shader_file->archive->shading_model_array + i;
-            break;
-        }
+    const std::string_view model_name = /* mIsOverride ? std::format("{}_override", mModelName) : */ SymbolTable::GetString(mModelName);
+    const g3d2::ResShadingModel* model = archive.FindModel(model_name);
+
+    if (model == nullptr) {
+        return -1;
     }
 
+    WriteKeys(archive, model);
+
+    return archive.FindProgram(model, mKeys.data());
+}
+
+std::vector<ShaderSelector::VariantMatch> ShaderSelector::SearchVariants(const ShaderArchive& archive, const std::string_view option_name, std::span<const std::string> values) {
+    std::vector<VariantMatch> matches{};
+
+    if (archive.GetName() != SymbolTable::GetString(mArchiveName)) {
+        return matches;
+    }
+
+    const g3d2::ResShadingModel* model = archive.FindModel(SymbolTable::GetString(mModelName));
+
     if (model == nullptr) {
-        return nullptr;
+        return matches;
+    }
+
+    WriteKeys(archive, model);
+
+    const OptionLookup& lookup = archive.GetOptionLookup(model);
+    const OptionLookup::OptionSlots slots = lookup.FindOptions(option_name);
+
+    // without the option every variant has the same key
+    if (slots.static_slot == -1 && slots.dynamic_slot == -1) {
+        const s32 program_index = archive.FindProgram(model, mKeys.data());
+        if (program_index >= 0) {
+            for (u32 i = 0; i < values.size(); ++i)
+                matches.push_back({ i, program_index });
+        }
+        return matches;
     }
 
-    WriteKeys(model);
+    // like WriteKeys, an option in both the static and the dynamic dict gets its choice written to both keys
+    const auto resolve_choice = [&lookup](s32 slot, std::string_view value) -> s32 {
+        if (slot == -1)
+            return -1;
+
+        const s32 choice = lookup.FindChoice(static_cast<u32>(slot), value);
+        return choice == -1 ? static_cast<s32>(lookup.GetOption(static_cast<u32>(slot))->default_choice) : choice;
+    };
+
+    // several values can map to the same choices (anything unknown becomes the default), only probe each combination once
+    struct Probe {
+        s32 static_choice;
+        s32 dynamic_choice;
+        s32 program_index;
+    };
+    std::vector<Probe> probes{};
+
+    for (u32 i = 0; i < values.size(); ++i) {
+        const s32 static_choice = resolve_choice(slots.static_slot, values[i]);
+        const s32 dynamic_choice = resolve_choice(slots.dynamic_slot, values[i]);
+
+        auto probe = std::find_if(probes.begin(), probes.end(), [&](const Probe& entry) {
+            return entry.static_choice == static_choice && entry.dynamic_choice == dynamic_choice;
+        });
+        if (probe == probes.end()) {
+            if (static_choice != -1)
+                WriteStaticKey(lookup.GetOption(static_cast<u32>(slots.static_slot)), static_cast<u32>(static_choice));
+            if (dynamic_choice != -1)
+                WriteDynamicKey(lookup.GetOption(static_cast<u32>(slots.dynamic_slot)), static_cast<u32>(dynamic_choice));
+
+            probes.push_back({ static_choice, dynamic_choice, archive.FindProgram(model, mKeys.data()) });
+            probe = std::prev(probes.end());
+        }
 
-    for (size_t i = 0; i < model->shader_program_count; ++i) {
-        const int opt_index = (model->static_key_count + model->dynamic_key_count) * static_cast<int>(i);
-        if (std::memcmp(model->key_table + opt_index, mKeys.data(), mKeys.size() * sizeof(u32)) == 0)
-            return model->program_array + i;
+        if (probe->program_index >= 0)
+            matches.push_back({ i, probe->program_index });
     }
 
-    return nullptr;
+    return matches;
 }
\ No newline at end of file
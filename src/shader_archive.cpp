@@ -0,0 +1,82 @@
+#include "shader_archive.h"
+
+#include "key_scan.h"
+
+bool ShaderArchive::Initialize(g3d2::ResShaderFile* file) {
+    if (file == nullptr)
+        return false;
+
+    mFile = file;
+    mModelData = std::make_unique<ModelData[]>(file->archive->shading_model_count);
+    for (size_t i = 0; i < GetModelCount(); ++i)
+        mModelData[i].columns.Initialize(GetModel(i));
+
+    return true;
+}
+
+const g3d2::ResShadingModel* ShaderArchive::FindModel(const std::string_view name) const {
+    for (size_t i = 0; i < GetModelCount(); ++i) {
+        if (GetModel(i)->name->Get() == name)
+            return GetModel(i);
+    }
+
+    return nullptr;
+}
+
+const ::gfx::ResShaderFile* ShaderArchive::GetShader(const g3d2::ResShadingModel* model) const {
+    auto& data = mModelData[GetModelIndex(model)];
+
+    std::call_once(data.shader_relocated, [model] {
+        ::gfx::ResShaderFile::ResCast(model->shader);
+    });
+
+    return model->shader;
+}
+
+const ::gfx::ResShaderVariation* ShaderArchive::GetVariation(const g3d2::ResShadingModel* model, size_t program_index) const {
+    // the variation pointer itself is relocated along with the bfsha but its contents belong to the BNSH
+    GetShader(model);
+
+    return model->program_array[program_index].variation;
+}
+
+const KeyHashIndex& ShaderArchive::GetKeyIndex(const g3d2::ResShadingModel* model) const {
+    auto& data = mModelData[GetModelIndex(model)];
+
+    std::call_once(data.key_index_built, [model, &data] {
+        data.key_index.Build(model->key_table, model->shader_program_count, model->static_key_count + model->dynamic_key_count);
+    });
+
+    return data.key_index;
+}
+
+s32 ShaderArchive::FindProgram(const g3d2::ResShadingModel* model, const u32* key) const {
+    if (model->shader_program_count < cKeyIndexMinPrograms)
+        return key_scan::FindExact(model->key_table, model->shader_program_count, model->static_key_count + model->dynamic_key_count, key);
+
+    return GetKeyIndex(model).Find(key);
+}
+
+const OptionBitmapIndex& ShaderArchive::GetOptionBitmaps(const g3d2::ResShadingModel* model) const {
+    auto& data = mModelData[GetModelIndex(model)];
+
+    std::call_once(data.option_bitmaps_built, [&data] {
+        data.option_bitmaps.Build(data.columns);
+    });
+
+    return data.option_bitmaps;
+}
+
+const OptionLookup& ShaderArchive::GetOptionLookup(const g3d2::ResShadingModel* model) const {
+    auto& data = mModelData[GetModelIndex(model)];
+
+    std::call_once(data.option_lookup_built, [model, &data] {
+        data.option_lookup.Build(model);
+    });
+
+    return data.option_lookup;
+}
+
+const KeyTableColumns& ShaderArchive::GetColumns(const g3d2::ResShadingModel* model) const {
+    return mModelData[GetModelIndex(model)].columns;
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "symbol_table.h"
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// the table is split into shards by hash so threads interning different strings rarely wait on each other
+// a symbol is the index of the string within its shard with the shard number in the low bits
+constexpr u32 cShardBits = 4;
+constexpr u32 cShardCount = 1u << cShardBits;
+
+struct Shard {
+    std::shared_mutex mutex;
+    std::unordered_map<std::string_view, Symbol> symbols;
+    std::deque<std::string> strings; // deque so existing strings (and the views into them) never move
+};
+
+std::array<Shard, cShardCount>& GetShards() {
+    static std::array<Shard, cShardCount> shards;
+    return shards;
+}
+
+u32 GetShardIndex(std::string_view str) {
+    const size_t hash = std::hash<std::string_view>{}(str);
+    return static_cast<u32>(hash ^ (hash >> 32)) & (cShardCount - 1);
+}
+
+} // namespace
+
+Symbol SymbolTable::Intern(std::string_view str) {
+    const u32 shard_index = GetShardIndex(str);
+    Shard& shard = GetShards()[shard_index];
+
+    {
+        std::shared_lock lock(shard.mutex);
+        const auto it = shard.symbols.find(str);
+        if (it != shard.symbols.end())
+            return it->second;
+    }
+
+    std::unique_lock lock(shard.mutex);
+    const auto it = shard.symbols.find(str);
+    if (it != shard.symbols.end())
+        return it->second;
+
+    const Symbol symbol = static_cast<Symbol>(shard.strings.size() << cShardBits) | shard_index;
+    const std::string& stored = shard.strings.emplace_back(str);
+    shard.symbols.emplace(std::string_view(stored), symbol);
+    return symbol;
+}
+
+Symbol SymbolTable::Find(std::string_view str) {
+    Shard& shard = GetShards()[GetShardIndex(str)];
+
+    std::shared_lock lock(shard.mutex);
+    const auto it = shard.symbols.find(str);
+    return it != shard.symbols.end() ? it->second : cInvalidSymbol;
+}
+
+std::string_view SymbolTable::GetString(Symbol symbol) {
+    if (symbol == cInvalidSymbol)
+        return {};
+
+    Shard& shard = GetShards()[symbol & (cShardCount - 1)];
+
+    std::shared_lock lock(shard.mutex);
+    return shard.strings[symbol >> cShardBits];
+}
+
+size_t SymbolTable::GetCount() {
+    size_t count = 0;
+    for (auto& shard : GetShards()) {
+        std::shared_lock lock(shard.mutex);
+        count += shard.strings.size();
+    }
+    return count;
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(u32 thread_count) {
+    if (thread_count == 0)
+        thread_count = 1;
+
+    mQueues.reserve(thread_count);
+    for (u32 i = 0; i < thread_count; ++i)
+        mQueues.emplace_back(std::make_unique<WorkQueue>());
+
+    mThreads.reserve(thread_count);
+    for (u32 i = 0; i < thread_count; ++i)
+        mThreads.emplace_back(&ThreadPool::WorkerMain, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mStateMutex);
+        mShutdown = true;
+    }
+    mWorkAvailable.notify_all();
+
+    for (auto& thread : mThreads)
+        thread.join();
+}
+
+void ThreadPool::Submit(Task task) {
+    std::lock_guard lock(mStateMutex);
+
+    auto& queue = *mQueues[mNextQueue];
+    mNextQueue = (mNextQueue + 1) % static_cast<u32>(mQueues.size());
+    {
+        std::lock_guard queue_lock(queue.mutex);
+        queue.tasks.emplace_back(std::move(task));
+    }
+
+    ++mPendingCount;
+    ++mQueuedCount;
+    mWorkAvailable.notify_one();
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock lock(mStateMutex);
+    mAllDone.wait(lock, [this] { return mPendingCount == 0; });
+
+    if (mException != nullptr) {
+        std::exception_ptr exception = mException;
+        mException = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+bool ThreadPool::TryPop(u32 index, Task& out_task) {
+    // own queue first (front), then steal from the others (back)
+    {
+        auto& queue = *mQueues[index];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            out_task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --mQueuedCount;
+            return true;
+        }
+    }
+
+    const u32 count = static_cast<u32>(mQueues.size());
+    for (u32 i = 1; i < count; ++i) {
+        auto& queue = *mQueues[(index + i) % count];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            out_task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --mQueuedCount;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::WorkerMain(u32 index) {
+    while (true) {
+        Task task;
+        if (TryPop(index, task)) {
+            std::exception_ptr exception = nullptr;
+            try {
+                task(index);
+            } catch (...) {
+                exception = std::current_exception();
+            }
+
+            std::lock_guard lock(mStateMutex);
+            if (exception != nullptr && mException == nullptr)
+                mException = exception;
+            if (--mPendingCount == 0)
+                mAllDone.notify_all();
+            continue;
+        }
+
+        std::unique_lock lock(mStateMutex);
+        mWorkAvailable.wait(lock, [this] { return mShutdown || mQueuedCount > 0; });
+        if (mShutdown && mQueuedCount == 0)
+            return;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "work_memory.h"
+
+#include <algorithm>
+
+static size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void WorkMemoryPool::Buffer::Grow(size_t size) {
+    if (size <= mSize)
+        return;
+
+    size = std::min(AlignUp(size, cBufferAlignment), cMaxBufferSize);
+
+    // free the old buffer first so the high-water mark doesn't count both
+    std::lock_guard lock(mPool->mMutex);
+    mData.reset();
+    mPool->Free(mSize);
+    mData = mPool->Allocate(size);
+    mSize = size;
+}
+
+void WorkMemoryPool::Buffer::Release() {
+    if (mPool == nullptr || mData == nullptr)
+        return;
+
+    mPool->Return(std::move(mData), mSize);
+    mPool = nullptr;
+    mSize = 0;
+}
+
+size_t WorkMemoryPool::GetRequiredSize(size_t decompressed_size) {
+    return std::clamp(AlignUp(decompressed_size * 2, cBufferAlignment), cMinBufferSize, cMaxBufferSize);
+}
+
+WorkMemoryPool::Buffer WorkMemoryPool::Acquire(size_t size) {
+    size = std::min(AlignUp(size, cBufferAlignment), cMaxBufferSize);
+
+    std::lock_guard lock(mMutex);
+
+    // take the largest free buffer, reallocating it if it turns out to be too small
+    if (!mFreeBuffers.empty()) {
+        auto it = std::max_element(mFreeBuffers.begin(), mFreeBuffers.end(), [](const FreeBuffer& lhs, const FreeBuffer& rhs) {
+            return lhs.size < rhs.size;
+        });
+        FreeBuffer buffer = std::move(*it);
+        mFreeBuffers.erase(it);
+
+        if (buffer.size >= size)
+            return Buffer(this, std::move(buffer.data), buffer.size);
+
+        buffer.data.reset();
+        Free(buffer.size);
+        --mBufferCount;
+    }
+
+    ++mBufferCount;
+    return Buffer(this, Allocate(size), size);
+}
+
+size_t WorkMemoryPool::GetHighWaterMark() const {
+    std::lock_guard lock(mMutex);
+    return mHighWaterMark;
+}
+
+size_t WorkMemoryPool::GetBufferCount() const {
+    std::lock_guard lock(mMutex);
+    return mBufferCount;
+}
+
+std::unique_ptr<u8[]> WorkMemoryPool::Allocate(size_t size) {
+    // left uninitialized, pages only get committed once the decompressor actually touches them
+    auto data = std::make_unique_for_overwrite<u8[]>(size);
+    mAllocatedSize += size;
+    mHighWaterMark = std::max(mHighWaterMark, mAllocatedSize);
+    return data;
+}
+
+void WorkMemoryPool::Free(size_t size) {
+    mAllocatedSize -= size;
+}
+
+void WorkMemoryPool::Return(std::unique_ptr<u8[]>&& data, size_t size) {
+    std::lock_guard lock(mMutex);
+    mFreeBuffers.emplace_back(std::move(data), size);
+}
\ No newline at end of file
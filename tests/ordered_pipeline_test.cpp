@@ -0,0 +1,117 @@
+#include "ordered_pipeline.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// the pipeline hanging instead of throwing shows up as the test timing out (see CMakeLists.txt)
+
+static int sFailures = 0;
+
+static void Check(bool condition, const char* what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++sFailures;
+    }
+}
+
+static OrderedPipeline<size_t, size_t> MakePipeline(const OrderedPipeline<size_t, size_t>::WriteFunc& write, size_t failing_parse = SIZE_MAX) {
+    return OrderedPipeline<size_t, size_t>(
+        [](size_t index) { return index; },
+        [](size_t, size_t& data) { data *= 2; },
+        [failing_parse](size_t index, size_t& data) {
+            if (index == failing_parse)
+                throw std::runtime_error("parse failed");
+            return data + 1;
+        },
+        write);
+}
+
+static void TestWritesInOrder(u32 job_count) {
+    constexpr size_t cCount = 1000;
+    std::vector<size_t> written{};
+    MakePipeline([&](size_t index, size_t& result) {
+        Check(index == written.size(), "results are written in item order");
+        written.push_back(result);
+    }).Run(cCount, job_count);
+
+    Check(written.size() == cCount, "every item is written");
+    for (size_t i = 0; i < written.size(); ++i)
+        Check(written[i] == i * 2 + 1, "every item goes through every stage");
+}
+
+static void TestLargestFirst(u32 job_count) {
+    // item i has size i, so each window is read back to front while the output stays in item order
+    constexpr size_t cCount = 100;
+    std::vector<size_t> read{};
+    std::vector<size_t> written{};
+    OrderedPipeline<size_t, size_t>(
+        [&](size_t index) {
+            read.push_back(index);
+            return index;
+        },
+        [](size_t, size_t&) {},
+        [](size_t, size_t& data) { return data; },
+        [&](size_t, size_t& result) { written.push_back(result); })
+        .Run(cCount, job_count, [](size_t index) { return index; });
+
+    const size_t window = OrderedPipeline<size_t, size_t>::GetMaxInFlight(job_count);
+    std::vector<size_t> expected{};
+    for (size_t begin = 0; begin < cCount; begin += window) {
+        for (size_t index = std::min(begin + window, cCount); index-- > begin;)
+            expected.push_back(index);
+    }
+
+    Check(read == expected, "items are read largest first within each window");
+    Check(written.size() == cCount, "every item is written");
+    for (size_t i = 0; i < written.size(); ++i)
+        Check(written[i] == i, "results are written in item order whatever the read order");
+}
+
+static void TestWriterThrows(u32 job_count) {
+    // the writer stops early while the workers still have plenty to push, so they are blocked on full queues and the reader on tickets
+    size_t written = 0;
+    std::string message{};
+    try {
+        MakePipeline([&](size_t index, size_t&) {
+            if (index == 10)
+                throw std::runtime_error("write failed");
+            ++written;
+        }).Run(10000, job_count);
+    } catch (const std::runtime_error& e) {
+        message = e.what();
+    }
+
+    Check(message == "write failed", "the writer's exception is rethrown");
+    Check(written == 10, "nothing is written after the writer fails");
+}
+
+static void TestStageThrows(u32 job_count) {
+    std::string message{};
+    try {
+        MakePipeline([](size_t, size_t&) {}, 500).Run(10000, job_count);
+    } catch (const std::runtime_error& e) {
+        message = e.what();
+    }
+
+    Check(message == "parse failed", "a stage's exception is rethrown");
+}
+
+int main() {
+    for (const u32 job_count : { 2u, 4u, 16u }) {
+        TestWritesInOrder(job_count);
+        TestLargestFirst(job_count);
+        TestWriterThrows(job_count);
+        TestStageThrows(job_count);
+    }
+
+    if (sFailures != 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", sFailures);
+        return 1;
+    }
+
+    std::printf("All checks passed\n");
+    return 0;
+}
\ No newline at end of file